@@ -0,0 +1,15 @@
+QT = core gui testlib
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+# The debug output of the tracker formats strings in every frame.
+DEFINES += QT_NO_DEBUG_OUTPUT
+
+TARGET = allocation_test
+TEMPLATE = app
+
+include(../tracker.pri)
+
+SOURCES += \
+    main.cpp
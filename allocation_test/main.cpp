@@ -0,0 +1,122 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+#include <QtTest>
+#include <QSharedPointer>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include "objectedgestracker.h"
+#include "objectmodel.h"
+#include "performancemonitor.h"
+#include "pinholecamera.h"
+
+namespace {
+
+// The calls of operator new in the whole process, cv::Mat allocates its header of the data by it too.
+std::atomic<std::size_t> countHeapAllocations(0);
+
+} // anonymous namespace
+
+// Not inlined, so the compiler doesn't take the pairs of malloc and operator delete for mismatched ones.
+Q_NEVER_INLINE void * operator new(std::size_t size)
+{
+    countHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void * p = std::malloc((size > 0) ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+Q_NEVER_INLINE void operator delete(void * p) noexcept
+{
+    std::free(p);
+}
+
+// Checks that the tracker doesn't allocate in a frame after the buffers of its stages are filled.
+// The tracker runs on a single thread, because a task of QtConcurrent allocates and so do
+// cv::distanceTransform and cv::Sobel, which are used by the other modes.
+class AllocationTest: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void steadyFrame_data();
+    void steadyFrame();
+
+private:
+    cv::Mat _createImage(const std::shared_ptr<PinholeCamera> & camera,
+                         const ObjectEdgesTracker::Pose & pose) const;
+};
+
+void AllocationTest::steadyFrame_data()
+{
+    QTest::addColumn<bool>("useExactDistanceTransform");
+    QTest::addColumn<float>("distanceBandRadius");
+
+    QTest::newRow("exact") << true << 0.0f;
+    QTest::newRow("narrow band") << false << 12.0f;
+}
+
+void AllocationTest::steadyFrame()
+{
+    QFETCH(bool, useExactDistanceTransform);
+    QFETCH(float, distanceBandRadius);
+
+    const int countWarmupFrames = 10;
+    const int countMeasuredFrames = 10;
+
+    QSharedPointer<PerformanceMonitor> monitor = QSharedPointer<PerformanceMonitor>::create();
+    ObjectEdgesTracker tracker(monitor);
+    tracker.setNumberWorkThreads(1);
+    tracker.setUsePipelining(false);
+    tracker.setUseBlobLabeling(true);
+    tracker.setNumberOrientationChannels(0);
+    tracker.setUseExactDistanceTransform(useExactDistanceTransform);
+    tracker.setDistanceBandRadius(distanceBandRadius);
+    std::shared_ptr<PinholeCamera> camera = std::make_shared<PinholeCamera>(Eigen::Vector2i(640, 480));
+    tracker.setCamera(camera);
+
+    // The object stays at the start pose of the tracker, so every frame takes the same path.
+    cv::Mat image = _createImage(camera, tracker.currentPose());
+    PoseFilter::TimePoint time = PoseFilter::Clock::now();
+    std::size_t frameAllocations[countMeasuredFrames];
+    for (int i = 0; i < countWarmupFrames + countMeasuredFrames; ++i)
+    {
+        time += std::chrono::milliseconds(33);
+        std::size_t startAllocations = countHeapAllocations.load(std::memory_order_relaxed);
+        tracker.compute(image, time, i);
+        std::size_t countAllocations = countHeapAllocations.load(std::memory_order_relaxed) - startAllocations;
+        if (i >= countWarmupFrames)
+            frameAllocations[i - countWarmupFrames] = countAllocations;
+    }
+    QCOMPARE(tracker.trackedFrameIndex(), countWarmupFrames + countMeasuredFrames - 1);
+
+    for (int i = 0; i < countMeasuredFrames; ++i)
+        QCOMPARE(frameAllocations[i], static_cast<std::size_t>(0));
+}
+
+cv::Mat AllocationTest::_createImage(const std::shared_ptr<PinholeCamera> & camera,
+                                     const ObjectEdgesTracker::Pose & pose) const
+{
+    // The edges of the model are drawn bright on a dark background, the lines are thin blobs.
+    Eigen::Vector2i imageSize = camera->imageSize();
+    cv::Mat colorImage(imageSize.y(), imageSize.x(), CV_8UC3, cv::Scalar(0, 0, 0));
+    Eigen::Quaterniond q = pose.rotation.normalized().conjugate();
+    Eigen::Matrix3f R = q.toRotationMatrix().cast<float>();
+    Eigen::Vector3f t = - (q * pose.position).cast<float>();
+    ObjectModel::createHouse().draw(colorImage, camera, R, t);
+    cv::Mat image;
+    cv::extractChannel(colorImage, image, 1);
+    return image;
+}
+
+QTEST_GUILESS_MAIN(AllocationTest)
+
+#include "main.moc"
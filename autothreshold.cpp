@@ -0,0 +1,84 @@
+#include "autothreshold.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+// The weight of the running histogram before a new frame is added.
+const double histogram_decay = 0.75;
+// The part of the distance to the new threshold passed in a frame.
+const double threshold_smoothing = 0.25;
+
+} // anonymous namespace
+
+AutoThreshold::AutoThreshold():
+    m_histogram(256, 0.0),
+    m_hasThreshold(false),
+    m_threshold(0.0)
+{
+}
+
+void AutoThreshold::reset()
+{
+    fill(m_histogram.begin(), m_histogram.end(), 0.0);
+    m_hasThreshold = false;
+}
+
+double AutoThreshold::update(const vector<int> & histogram, double currentThreshold)
+{
+    int count = 0;
+    for (int value : histogram)
+        count += value;
+    if (count == 0)
+        return m_hasThreshold ? m_threshold : currentThreshold;
+
+    // The frames are normalized, so the running histogram doesn't depend on the size of the region.
+    double scale = (1.0 - histogram_decay) / count;
+    for (size_t i = 0; i < m_histogram.size(); ++i)
+        m_histogram[i] = m_histogram[i] * histogram_decay + histogram[i] * scale;
+
+    double threshold = static_cast<double>(_otsuThreshold(m_histogram));
+    if (!m_hasThreshold)
+    {
+        m_threshold = threshold;
+        m_hasThreshold = true;
+    }
+    else
+    {
+        m_threshold += (threshold - m_threshold) * threshold_smoothing;
+    }
+    return m_threshold;
+}
+
+int AutoThreshold::_otsuThreshold(const vector<double> & histogram)
+{
+    // The threshold t splits the values into [0, t] and (t, 255], as cv::threshold with THRESH_BINARY does.
+    double total = 0.0, totalSum = 0.0;
+    for (size_t i = 0; i < histogram.size(); ++i)
+    {
+        total += histogram[i];
+        totalSum += histogram[i] * i;
+    }
+    double weight0 = 0.0, sum0 = 0.0;
+    double maxVariance = -1.0;
+    int threshold = 0;
+    for (size_t i = 0; i + 1 < histogram.size(); ++i)
+    {
+        weight0 += histogram[i];
+        sum0 += histogram[i] * i;
+        double weight1 = total - weight0;
+        if ((weight0 <= 0.0) || (weight1 <= 0.0))
+            continue;
+        double mean0 = sum0 / weight0;
+        double mean1 = (totalSum - sum0) / weight1;
+        double variance = weight0 * weight1 * (mean0 - mean1) * (mean0 - mean1);
+        if (variance > maxVariance)
+        {
+            maxVariance = variance;
+            threshold = static_cast<int>(i);
+        }
+    }
+    return threshold;
+}
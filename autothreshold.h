@@ -0,0 +1,28 @@
+#ifndef AUTOTHRESHOLD_H
+#define AUTOTHRESHOLD_H
+
+#include <vector>
+
+// Chooses the binarization threshold of the frames as they come. The histograms of the frames are
+// accumulated into a running histogram which forgets the old frames, the Otsu threshold of this histogram
+// is smoothed over time, so the threshold follows the light without flickering.
+class AutoThreshold
+{
+public:
+    AutoThreshold();
+
+    void reset();
+
+    // Adds the 256-bin histogram of a frame and returns the threshold. The current threshold is kept
+    // while there are no samples.
+    double update(const std::vector<int> & histogram, double currentThreshold);
+
+private:
+    std::vector<double> m_histogram;
+    bool m_hasThreshold;
+    double m_threshold;
+
+    static int _otsuThreshold(const std::vector<double> & histogram);
+};
+
+#endif // AUTOTHRESHOLD_H
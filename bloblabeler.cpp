@@ -0,0 +1,395 @@
+#include "bloblabeler.h"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+// The contribution of a 2x2 cell to the area and to the perimeter of the outer contour of a filled blob,
+// indexed by the mask of the cell pixels which belong to it: 1 - top left, 2 - top right,
+// 4 - bottom left, 8 - bottom right. The contour goes through pixel centers, so a cell with
+// three pixels cuts a half of the cell by a diagonal and a cell with two diagonal pixels
+// is passed along the diagonal in both directions.
+const double sqrt2 = std::sqrt(2.0);
+
+const double cell_area[16] = {
+    0.0, 0.0, 0.0, 0.0,
+    0.0, 0.0, 0.0, 0.5,
+    0.0, 0.0, 0.0, 0.5,
+    0.0, 0.5, 0.5, 1.0
+};
+
+const double cell_perimeter[16] = {
+    0.0, 0.0, 0.0, 1.0,
+    0.0, 1.0, 2.0 * sqrt2, sqrt2,
+    0.0, 2.0 * sqrt2, 1.0, sqrt2,
+    1.0, sqrt2, sqrt2, 0.0
+};
+
+} // anonymous namespace
+
+double BlobLabeler::Blob::circularity() const
+{
+    return 4.0 * M_PI * area / (perimeter * perimeter);
+}
+
+double BlobLabeler::Hole::circularity() const
+{
+    return 4.0 * M_PI * area / (perimeter * perimeter);
+}
+
+void BlobLabeler::label(const cv::Mat & binImage)
+{
+    CV_Assert(binImage.type() == CV_8UC1);
+
+    int rows = binImage.rows, cols = binImage.cols;
+    m_labels.create(rows, cols, CV_32SC1);
+    m_parents.clear();
+    m_enclosing.clear();
+    m_foreground.clear();
+    _newLabel(false, -1);
+
+    // Foreground is 8-connected and background is 4-connected, so a foreground blob and its holes
+    // are separated by its contours. The pixels above and on the left of the current one are labeled.
+    for (int y = 0; y < rows; ++y)
+    {
+        const uchar * src = binImage.ptr<uchar>(y);
+        const uchar * prevSrc = (y > 0) ? binImage.ptr<uchar>(y - 1) : nullptr;
+        int * row = m_labels.ptr<int>(y);
+        const int * prevRow = (y > 0) ? m_labels.ptr<int>(y - 1) : nullptr;
+        bool borderRow = (y == 0) || (y == rows - 1);
+        for (int x = 0; x < cols; ++x)
+        {
+            int label = -1;
+            if (src[x] != 0)
+            {
+                if (prevSrc && (prevSrc[x] != 0))
+                {
+                    // The other upper and left neighbours are connected with the upper one already.
+                    label = prevRow[x];
+                }
+                else
+                {
+                    if ((x > 0) && (src[x - 1] != 0))
+                        label = row[x - 1];
+                    else if (prevSrc && (x > 0) && (prevSrc[x - 1] != 0))
+                        label = prevRow[x - 1];
+                    if (prevSrc && (x + 1 < cols) && (prevSrc[x + 1] != 0))
+                        label = (label < 0) ? prevRow[x + 1] : _merge(label, prevRow[x + 1]);
+                }
+                if (label < 0)
+                    label = _newLabel(true, (x > 0) ? row[x - 1] : 0);
+            }
+            else
+            {
+                if ((x > 0) && (src[x - 1] == 0))
+                    label = row[x - 1];
+                if (prevSrc && (prevSrc[x] == 0))
+                    label = (label < 0) ? prevRow[x] : _merge(label, prevRow[x]);
+                if (borderRow || (x == 0) || (x == cols - 1))
+                    label = (label < 0) ? 0 : _merge(label, 0);
+                if (label < 0)
+                    label = _newLabel(false, prevRow[x]);
+            }
+            row[x] = label;
+        }
+    }
+
+    _resolveLabels();
+    _computeStatistics();
+}
+
+const std::vector<BlobLabeler::Blob> & BlobLabeler::blobs() const
+{
+    return m_blobs;
+}
+
+const std::vector<BlobLabeler::Hole> & BlobLabeler::holes() const
+{
+    return m_holes;
+}
+
+void BlobLabeler::filter(cv::Mat & binImage, const std::vector<uchar> & keepBlobs,
+                         const std::vector<uchar> & keepHoles)
+{
+    selectBlobs(keepBlobs, keepHoles);
+    for (int y = 0; y < binImage.rows; ++y)
+        filterRow(binImage, y, binImage.ptr<uchar>(y));
+}
+
+void BlobLabeler::selectBlobs(const std::vector<uchar> & keepBlobs, const std::vector<uchar> & keepHoles)
+{
+    CV_Assert((keepBlobs.size() == m_blobs.size()) && (keepHoles.size() == m_holes.size()));
+
+    // The blob of a hole always has a smaller index than the blobs inside of the hole,
+    // so a cleared enclosing blob is known before the blobs it encloses.
+    m_keepBlobs.resize(m_blobs.size());
+    for (size_t i = 0; i < m_blobs.size(); ++i)
+    {
+        int hole = m_blobs[i].hole;
+        m_keepBlobs[i] = ((keepBlobs[i] != 0) &&
+                          ((hole < 0) ||
+                           ((keepHoles[static_cast<size_t>(hole)] != 0) &&
+                            (m_keepBlobs[static_cast<size_t>(m_holes[static_cast<size_t>(hole)].blob)] != 0)))) ? 1 : 0;
+    }
+    m_keepHoles.resize(m_holes.size());
+    for (size_t i = 0; i < m_holes.size(); ++i)
+    {
+        m_keepHoles[i] = ((keepHoles[i] != 0) &&
+                          (m_keepBlobs[static_cast<size_t>(m_holes[i].blob)] != 0)) ? 1 : 0;
+    }
+
+    m_labelMasks.resize(m_parents.size());
+    m_clearedHoleLabels.resize(m_parents.size());
+    m_hasClearedHoles = false;
+    for (size_t i = 0; i < m_parents.size(); ++i)
+    {
+        m_labelMasks[i] = (m_foreground[i] &&
+                           m_keepBlobs[static_cast<size_t>(m_labelBlobs[i])]) ? 0xFF : 0x00;
+        int hole = m_labelHoles[i];
+        m_clearedHoleLabels[i] = (!m_foreground[i] && (hole >= 0) &&
+                                  (m_keepHoles[static_cast<size_t>(hole)] == 0)) ? 1 : 0;
+        if (m_clearedHoleLabels[i])
+            m_hasClearedHoles = true;
+    }
+}
+
+void BlobLabeler::filterRow(const cv::Mat & binImage, int y, uchar * dst) const
+{
+    CV_Assert((binImage.size() == m_labels.size()) && (binImage.type() == CV_8UC1));
+
+    const uchar * src = binImage.ptr<uchar>(y);
+    const int * row = m_labels.ptr<int>(y);
+    int cols = binImage.cols;
+    if (!m_hasClearedHoles)
+    {
+        for (int x = 0; x < cols; ++x)
+            dst[x] = src[x] & m_labelMasks[static_cast<size_t>(row[x])];
+        return;
+    }
+    const int * prevRow = (y > 0) ? m_labels.ptr<int>(y - 1) : nullptr;
+    const int * nextRow = (y + 1 < m_labels.rows) ? m_labels.ptr<int>(y + 1) : nullptr;
+    auto isCleared = [this] (int label) { return m_clearedHoleLabels[static_cast<size_t>(label)] != 0; };
+    for (int x = 0; x < cols; ++x)
+    {
+        uchar value = src[x] & m_labelMasks[static_cast<size_t>(row[x])];
+        if ((value != 0) &&
+                (((x > 0) && isCleared(row[x - 1])) || ((x + 1 < cols) && isCleared(row[x + 1])) ||
+                 (prevRow && isCleared(prevRow[x])) || (nextRow && isCleared(nextRow[x]))))
+        {
+            value = 0;
+        }
+        dst[x] = value;
+    }
+}
+
+void BlobLabeler::markBlobsInMask(const cv::Mat & mask, int cellShift,
+                                  std::vector<uchar> & blobFlags, std::vector<uchar> & holeFlags) const
+{
+    CV_Assert(mask.type() == CV_8UC1);
+    CV_Assert((((m_labels.rows - 1) >> cellShift) < mask.rows) && (((m_labels.cols - 1) >> cellShift) < mask.cols));
+
+    blobFlags.assign(m_blobs.size(), 0);
+    holeFlags.assign(m_holes.size(), 0);
+    int cellSize = 1 << cellShift;
+    for (int y = 0; y < m_labels.rows; ++y)
+    {
+        const uchar * maskRow = mask.ptr<uchar>(y >> cellShift);
+        const int * row = m_labels.ptr<int>(y);
+        const int * prevRow = (y > 0) ? m_labels.ptr<int>(y - 1) : nullptr;
+        const int * nextRow = (y + 1 < m_labels.rows) ? m_labels.ptr<int>(y + 1) : nullptr;
+        // The contour of a hole goes through the blob pixels next to it, so a hole is flagged by them.
+        auto markHole = [&] (int label)
+        {
+            if (!m_foreground[static_cast<size_t>(label)] && (m_labelHoles[static_cast<size_t>(label)] >= 0))
+                holeFlags[static_cast<size_t>(m_labelHoles[static_cast<size_t>(label)])] = 1;
+        };
+        for (int cellX = 0; cellX < mask.cols; ++cellX)
+        {
+            if (maskRow[cellX] == 0)
+                continue;
+            int endX = min((cellX + 1) * cellSize, m_labels.cols);
+            for (int x = cellX * cellSize; x < endX; ++x)
+            {
+                size_t label = static_cast<size_t>(row[x]);
+                if (!m_foreground[label])
+                    continue;
+                blobFlags[static_cast<size_t>(m_labelBlobs[label])] = 1;
+                if (x > 0)
+                    markHole(row[x - 1]);
+                if (x + 1 < m_labels.cols)
+                    markHole(row[x + 1]);
+                if (prevRow)
+                    markHole(prevRow[x]);
+                if (nextRow)
+                    markHole(nextRow[x]);
+            }
+        }
+    }
+}
+
+int BlobLabeler::_newLabel(bool foreground, int enclosing)
+{
+    int label = static_cast<int>(m_parents.size());
+    m_parents.push_back(label);
+    m_enclosing.push_back(enclosing);
+    m_foreground.push_back(foreground ? 1 : 0);
+    return label;
+}
+
+int BlobLabeler::_find(int label)
+{
+    while (m_parents[static_cast<size_t>(label)] != label)
+    {
+        int & parent = m_parents[static_cast<size_t>(label)];
+        parent = m_parents[static_cast<size_t>(parent)];
+        label = parent;
+    }
+    return label;
+}
+
+int BlobLabeler::_merge(int a, int b)
+{
+    a = _find(a);
+    b = _find(b);
+    if (a < b)
+    {
+        m_parents[static_cast<size_t>(b)] = a;
+        return a;
+    }
+    m_parents[static_cast<size_t>(a)] = b;
+    return b;
+}
+
+void BlobLabeler::_resolveLabels()
+{
+    // The parent of a label is never greater than the label,
+    // so a single forward pass brings every label to its root.
+    m_labelBlobs.resize(m_parents.size());
+    m_labelHoles.resize(m_parents.size());
+    m_blobs.clear();
+    m_holes.clear();
+    for (size_t i = 0; i < m_parents.size(); ++i)
+    {
+        int root = m_parents[static_cast<size_t>(m_parents[i])];
+        m_parents[i] = root;
+        if (root != static_cast<int>(i))
+        {
+            m_labelBlobs[i] = m_labelBlobs[static_cast<size_t>(root)];
+            m_labelHoles[i] = m_labelHoles[static_cast<size_t>(root)];
+            continue;
+        }
+        if (i == 0)
+        {
+            m_labelBlobs[i] = -1;
+            m_labelHoles[i] = -1;
+            continue;
+        }
+        // The enclosing component of a root was labeled before it, so it is resolved already.
+        size_t enclosing = static_cast<size_t>(m_parents[static_cast<size_t>(m_enclosing[i])]);
+        if (m_foreground[i])
+        {
+            m_labelBlobs[i] = static_cast<int>(m_blobs.size());
+            m_labelHoles[i] = m_labelHoles[enclosing];
+            m_blobs.push_back({ 0.0, 0.0, m_labelHoles[enclosing] });
+        }
+        else
+        {
+            m_labelBlobs[i] = m_labelBlobs[enclosing];
+            m_labelHoles[i] = static_cast<int>(m_holes.size());
+            m_holes.push_back({ 0.0, 0.0, m_labelBlobs[enclosing] });
+        }
+    }
+}
+
+int BlobLabeler::_labelRegion(int label) const
+{
+    size_t i = static_cast<size_t>(label);
+    if (m_foreground[i])
+        return m_labelBlobs[i] * 2;
+    return (m_labelHoles[i] >= 0) ? (m_labelHoles[i] * 2 + 1) : -1;
+}
+
+int BlobLabeler::_enclosingRegion(int region) const
+{
+    if (region & 1)
+        return m_holes[static_cast<size_t>(region >> 1)].blob * 2;
+    int hole = m_blobs[static_cast<size_t>(region >> 1)].hole;
+    return (hole >= 0) ? (hole * 2 + 1) : -1;
+}
+
+void BlobLabeler::_computeStatistics()
+{
+    // The outer contour of a blob is the contour of the blob with filled holes and the contour of a hole
+    // is the contour of the filled hole, so their areas and perimeters are sums over the 2x2 cells
+    // of the padded image. A pixel belongs to the filled region of its own label and to the filled
+    // regions of all enclosing ones. The contour of a filled blob goes through its own pixels, while
+    // the contour of a filled hole goes through the pixels outside of it, so a hole sees a cell
+    // as a blob would see the complement of the cell.
+    int rows = m_labels.rows, cols = m_labels.cols;
+    size_t rowSize = static_cast<size_t>(cols + 2);
+    m_rowRegions.assign(rowSize * 2, -1);
+    int * prev = m_rowRegions.data();
+    int * cur = prev + rowSize;
+    for (int y = 0; y <= rows; ++y)
+    {
+        if (y < rows)
+        {
+            const int * row = m_labels.ptr<int>(y);
+            for (int x = 0; x < cols; ++x)
+                cur[x + 1] = _labelRegion(row[x]);
+        }
+        else
+        {
+            fill(cur, cur + rowSize, -1);
+        }
+        for (int x = 0; x <= cols; ++x)
+        {
+            const int cell[4] = { prev[x], prev[x + 1], cur[x], cur[x + 1] };
+            if ((cell[0] == cell[1]) && (cell[0] == cell[2]) && (cell[0] == cell[3]))
+            {
+                for (int region = cell[0]; region >= 0; region = _enclosingRegion(region))
+                {
+                    if (region & 1)
+                        m_holes[static_cast<size_t>(region >> 1)].area += 1.0;
+                    else
+                        m_blobs[static_cast<size_t>(region >> 1)].area += 1.0;
+                }
+                continue;
+            }
+            // Nested regions share the tail of their chains, so a cell touches just a few of them.
+            m_cellRegions.clear();
+            for (int i = 0; i < 4; ++i)
+            {
+                for (int region = cell[i]; region >= 0; region = _enclosingRegion(region))
+                {
+                    auto it = find_if(m_cellRegions.begin(), m_cellRegions.end(),
+                                      [region] (const pair<int, int> & r) { return r.first == region; });
+                    if (it == m_cellRegions.end())
+                        m_cellRegions.emplace_back(region, 1 << i);
+                    else
+                        it->second |= (1 << i);
+                }
+            }
+            for (const pair<int, int> & cellRegion : m_cellRegions)
+            {
+                if (cellRegion.first & 1)
+                {
+                    Hole & hole = m_holes[static_cast<size_t>(cellRegion.first >> 1)];
+                    int outside = 15 & ~cellRegion.second;
+                    hole.area += 1.0 - cell_area[outside];
+                    hole.perimeter += cell_perimeter[outside];
+                }
+                else
+                {
+                    Blob & blob = m_blobs[static_cast<size_t>(cellRegion.first >> 1)];
+                    blob.area += cell_area[cellRegion.second];
+                    blob.perimeter += cell_perimeter[cellRegion.second];
+                }
+            }
+        }
+        swap(prev, cur);
+    }
+}
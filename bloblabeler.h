@@ -0,0 +1,88 @@
+#ifndef BLOBLABELER_H
+#define BLOBLABELER_H
+
+#include <vector>
+#include <utility>
+
+#include <opencv2/core.hpp>
+
+// Labels 8-connected blobs of a binary image and gathers the statistics of their outer and hole contours,
+// so blobs can be filtered without cv::findContours and a cv::drawContours call per rejected contour.
+// The area and the perimeter of a blob or a hole are equal to cv::moments(contour).m00 and
+// cv::arcLength(contour, true) of its contour found with cv::CHAIN_APPROX_NONE.
+class BlobLabeler
+{
+public:
+    struct Blob
+    {
+        double area;
+        double perimeter;
+        int hole; // the hole of another blob which encloses this one, -1 if there is none
+
+        double circularity() const;
+    };
+
+    // A 4-connected background component enclosed by a blob.
+    struct Hole
+    {
+        double area;
+        double perimeter;
+        int blob; // the blob which has this hole
+
+        double circularity() const;
+    };
+
+    void label(const cv::Mat & binImage);
+
+    const std::vector<Blob> & blobs() const;
+    const std::vector<Hole> & holes() const;
+
+    // Clears the blobs and the holes with zero flags in a single sweep. As with filling the contour,
+    // everything that lies inside of a cleared blob or hole is cleared too. The contour of a hole
+    // goes through the pixels of its blob which are 4-connected with the hole, so they are cleared as well.
+    void filter(cv::Mat & binImage, const std::vector<uchar> & keepBlobs, const std::vector<uchar> & keepHoles);
+
+    // The same filtering split into the selection and the rows, so the rows can be streamed further.
+    void selectBlobs(const std::vector<uchar> & keepBlobs, const std::vector<uchar> & keepHoles);
+    void filterRow(const cv::Mat & binImage, int y, uchar * dst) const;
+
+    // Flags the blobs with pixels and the holes with contour pixels in the nonzero cells of the mask,
+    // where a cell of the mask covers (1 << cellShift) x (1 << cellShift) pixels of the labeled image.
+    void markBlobsInMask(const cv::Mat & mask, int cellShift,
+                         std::vector<uchar> & blobFlags, std::vector<uchar> & holeFlags) const;
+
+private:
+    cv::Mat m_labels;
+    // Provisional labels of foreground and background components, the label 0 is the background
+    // connected with the image border. A union keeps the smaller label, so the root of a component
+    // is the label of its first pixel in the raster order.
+    std::vector<int> m_parents;
+    // The label of the component which surrounds the first pixel of the component.
+    std::vector<int> m_enclosing;
+    std::vector<uchar> m_foreground;
+    // The blob of a foreground label or the blob whose hole contains a background label.
+    std::vector<int> m_labelBlobs;
+    // The hole of a background label or the hole which encloses the blob of a foreground label.
+    std::vector<int> m_labelHoles;
+    // Blobs and holes are nested regions, a blob b is the region 2 * b and a hole h is the region 2 * h + 1.
+    std::vector<int> m_rowRegions;
+    std::vector<std::pair<int, int>> m_cellRegions;
+    std::vector<uchar> m_labelMasks;
+    // Nonzero for the background labels of cleared holes, the foreground pixels next to them are cleared.
+    std::vector<uchar> m_clearedHoleLabels;
+    bool m_hasClearedHoles;
+    std::vector<uchar> m_keepBlobs;
+    std::vector<uchar> m_keepHoles;
+    std::vector<Blob> m_blobs;
+    std::vector<Hole> m_holes;
+
+    int _newLabel(bool foreground, int enclosing);
+    int _find(int label);
+    int _merge(int a, int b);
+    void _resolveLabels();
+    int _labelRegion(int label) const;
+    int _enclosingRegion(int region) const;
+    void _computeStatistics();
+};
+
+#endif // BLOBLABELER_H
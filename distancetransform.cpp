@@ -0,0 +1,377 @@
+#include "distancetransform.h"
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "parallelstripes.h"
+
+using namespace std;
+using namespace Eigen;
+
+namespace {
+
+// The weights of cv::distanceTransform for DIST_L2 with the 3x3 mask.
+const float chamfer_hv = 0.955f;
+const float chamfer_diag = 1.3693f;
+
+const int band_tile_size = 16;
+
+// The least numbers of the columns and of the rows of a stripe of the exact transform.
+const int exact_min_stripe_cols = 16;
+const int exact_min_stripe_rows = 8;
+
+using Span = DistanceTransformBuffers::Span;
+
+// Runs both chamfer passes over the rows of the edges, which start from the first row of the image.
+// The distances are filled with the radius beforehand.
+void chamferRows(const cv::Mat & edges, cv::Mat & distances, int firstRow,
+                 const vector<vector<Span>> & tileRowSpans, float radius, vector<float> & borderRow)
+{
+    // The pixels out of the spans keep the radius, so they never shorten a path. Every value is
+    // clamped to the radius, which gives the clamped result of the unbounded two-pass algorithm.
+    int rows = edges.rows, cols = edges.cols;
+    borderRow.assign(static_cast<size_t>(cols), radius);
+    for (int y = 0; y < rows; ++y)
+    {
+        const uchar * e = edges.ptr<uchar>(y);
+        float * d = distances.ptr<float>(y);
+        const float * up = (y > 0) ? distances.ptr<float>(y - 1) : borderRow.data();
+        for (const Span & span : tileRowSpans[static_cast<size_t>((firstRow + y) / band_tile_size)])
+        {
+            for (int x = span.begin; x < span.end; ++x)
+            {
+                if (e[x] == 0)
+                {
+                    d[x] = 0.0f;
+                    continue;
+                }
+                float t0 = up[x] + chamfer_hv;
+                if (x > 0)
+                    t0 = min(t0, min(up[x - 1] + chamfer_diag, d[x - 1] + chamfer_hv));
+                if (x + 1 < cols)
+                    t0 = min(t0, up[x + 1] + chamfer_diag);
+                d[x] = min(t0, radius);
+            }
+        }
+    }
+    for (int y = rows - 1; y >= 0; --y)
+    {
+        float * d = distances.ptr<float>(y);
+        const float * down = (y + 1 < rows) ? distances.ptr<float>(y + 1) : borderRow.data();
+        const vector<Span> & spans = tileRowSpans[static_cast<size_t>((firstRow + y) / band_tile_size)];
+        for (auto it = spans.crbegin(); it != spans.crend(); ++it)
+        {
+            for (int x = it->end - 1; x >= it->begin; --x)
+            {
+                float t0 = d[x];
+                if (t0 <= chamfer_hv)
+                    continue;
+                t0 = min(t0, down[x] + chamfer_hv);
+                if (x + 1 < cols)
+                    t0 = min(t0, min(down[x + 1] + chamfer_diag, d[x + 1] + chamfer_hv));
+                if (x > 0)
+                    t0 = min(t0, down[x - 1] + chamfer_diag);
+                d[x] = t0;
+            }
+        }
+    }
+}
+
+void gradientFieldRow(const float * row, const float * prevRow, float * field, int width)
+{
+    int x = 1;
+#if defined(__SSE2__)
+    const __m128 zero = _mm_setzero_ps();
+    for (; x <= width - 4; x += 4)
+    {
+        __m128 d = _mm_loadu_ps(row + x);
+        __m128 dx = _mm_sub_ps(d, _mm_loadu_ps(row + x - 1));
+        __m128 dy = _mm_sub_ps(d, _mm_loadu_ps(prevRow + x));
+        __m128 pad = zero;
+        _MM_TRANSPOSE4_PS(d, dx, dy, pad);
+        _mm_storeu_ps(field + x * 4, d);
+        _mm_storeu_ps(field + x * 4 + 4, dx);
+        _mm_storeu_ps(field + x * 4 + 8, dy);
+        _mm_storeu_ps(field + x * 4 + 12, pad);
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; x <= width - 4; x += 4)
+    {
+        float32x4x4_t texels;
+        texels.val[0] = vld1q_f32(row + x);
+        texels.val[1] = vsubq_f32(texels.val[0], vld1q_f32(row + x - 1));
+        texels.val[2] = vsubq_f32(texels.val[0], vld1q_f32(prevRow + x));
+        texels.val[3] = vdupq_n_f32(0.0f);
+        vst4q_f32(field + x * 4, texels);
+    }
+#endif
+    for (; x < width; ++x)
+    {
+        field[x * 4] = row[x];
+        field[x * 4 + 1] = row[x] - row[x - 1];
+        field[x * 4 + 2] = row[x] - prevRow[x];
+        field[x * 4 + 3] = 0.0f;
+    }
+}
+
+// Finds the nearest zero pixels above and below in the columns of the edges, the sweeps go along the rows,
+// so the memory is read in order. The rows of the columns without zero pixels are -1.
+void nearestColumnEdges(const cv::Mat & edges, cv::Mat & nearestRows, int beginCol, int endCol,
+                        vector<int> & below)
+{
+    int rows = edges.rows;
+    below.assign(static_cast<size_t>(endCol - beginCol), -1);
+    for (int y = 0; y < rows; ++y)
+    {
+        const uchar * e = edges.ptr<uchar>(y);
+        const int * up = (y > 0) ? nearestRows.ptr<int>(y - 1) : nullptr;
+        int * r = nearestRows.ptr<int>(y);
+        for (int x = beginCol; x < endCol; ++x)
+            r[x] = (e[x] == 0) ? y : (up ? up[x] : -1);
+    }
+    for (int y = rows - 1; y >= 0; --y)
+    {
+        const uchar * e = edges.ptr<uchar>(y);
+        int * r = nearestRows.ptr<int>(y);
+        for (int x = beginCol; x < endCol; ++x)
+        {
+            int & b = below[static_cast<size_t>(x - beginCol)];
+            if (e[x] == 0)
+                b = y;
+            if ((b >= 0) && ((r[x] < 0) || (b - y < y - r[x])))
+                r[x] = b;
+        }
+    }
+}
+
+// The lower envelope of the parabolas (x - q)^2 + (y - nearestRow[q])^2 of the columns q along a row.
+// There is a parabola at least, as the image has zero pixels.
+void envelopeRow(int y, const int * nearestRow, int cols, float * distances, cv::Vec2i * nearest,
+                 vector<int> & v, vector<double> & z, vector<double> & f)
+{
+    int k = -1;
+    for (int q = 0; q < cols; ++q)
+    {
+        if (nearestRow[q] < 0)
+            continue;
+        double dy = static_cast<double>(y - nearestRow[q]);
+        f[static_cast<size_t>(q)] = dy * dy + static_cast<double>(q) * q;
+        double s = - numeric_limits<double>::infinity();
+        while (k >= 0)
+        {
+            int p = v[static_cast<size_t>(k)];
+            s = (f[static_cast<size_t>(q)] - f[static_cast<size_t>(p)]) / (2.0 * (q - p));
+            if (s > z[static_cast<size_t>(k)])
+                break;
+            --k;
+        }
+        if (k < 0)
+            s = - numeric_limits<double>::infinity();
+        ++k;
+        v[static_cast<size_t>(k)] = q;
+        z[static_cast<size_t>(k)] = s;
+    }
+    z[static_cast<size_t>(k + 1)] = numeric_limits<double>::infinity();
+    int j = 0;
+    for (int x = 0; x < cols; ++x)
+    {
+        while (z[static_cast<size_t>(j + 1)] < x)
+            ++j;
+        int p = v[static_cast<size_t>(j)];
+        double d = f[static_cast<size_t>(p)] - static_cast<double>(p) * p + static_cast<double>(x - p) * (x - p);
+        distances[x] = static_cast<float>(sqrt(d));
+        if (nearest)
+            nearest[x] = cv::Vec2i(p, nearestRow[p]);
+    }
+}
+
+} // anonymous namespace
+
+void narrowBandDistanceTransform(const cv::Mat & edges, cv::Mat & distanceMap,
+                                 const Vectors2f & bandPoints, float radius,
+                                 QThreadPool * pool, size_t numberStripes,
+                                 DistanceTransformBuffers * buffers)
+{
+    CV_Assert(edges.type() == CV_8UC1);
+    CV_Assert(radius > 0.0f);
+
+    DistanceTransformBuffers localBuffers;
+    if (!buffers)
+        buffers = &localBuffers;
+
+    int rows = edges.rows, cols = edges.cols;
+    distanceMap.create(rows, cols, CV_32FC1);
+
+    int tilesX = (cols + band_tile_size - 1) / band_tile_size;
+    int tilesY = (rows + band_tile_size - 1) / band_tile_size;
+    if ((tilesX == 0) || (tilesY == 0))
+        return;
+
+    // A chamfer path not longer than the radius doesn't leave the square of the radius divided by
+    // the smallest weight, so the tiles in this reach of the band are enough for exact distances in the band.
+    vector<uchar> & bandTiles = buffers->bandTiles;
+    bandTiles.assign(static_cast<size_t>(tilesX * tilesY), 0);
+    float reach = radius + radius / chamfer_hv + 1.0f;
+    for (const Vector2f & point : bandPoints)
+    {
+        if (!point.allFinite())
+            continue;
+        float minX = max(point.x() - reach, 0.0f), maxX = min(point.x() + reach, cols - 1.0f);
+        float minY = max(point.y() - reach, 0.0f), maxY = min(point.y() + reach, rows - 1.0f);
+        if ((minX > maxX) || (minY > maxY))
+            continue;
+        int tx0 = static_cast<int>(minX) / band_tile_size, tx1 = static_cast<int>(maxX) / band_tile_size;
+        int ty0 = static_cast<int>(minY) / band_tile_size, ty1 = static_cast<int>(maxY) / band_tile_size;
+        for (int ty = ty0; ty <= ty1; ++ty)
+            fill_n(&bandTiles[static_cast<size_t>(ty * tilesX + tx0)], tx1 - tx0 + 1, 1);
+    }
+
+    // The span vectors keep their memory, they are only cleared.
+    vector<vector<Span>> & tileRowSpans = buffers->tileRowSpans;
+    if (tileRowSpans.size() < static_cast<size_t>(tilesY))
+        tileRowSpans.resize(static_cast<size_t>(tilesY));
+    for (int ty = 0; ty < tilesY; ++ty)
+    {
+        tileRowSpans[static_cast<size_t>(ty)].clear();
+        const uchar * tiles = &bandTiles[static_cast<size_t>(ty * tilesX)];
+        for (int tx = 0; tx < tilesX; )
+        {
+            if (!tiles[tx])
+            {
+                ++tx;
+                continue;
+            }
+            int begin = tx;
+            while ((tx < tilesX) && tiles[tx])
+                ++tx;
+            tileRowSpans[static_cast<size_t>(ty)].push_back({ begin * band_tile_size,
+                                                              min(tx * band_tile_size, cols) });
+        }
+    }
+
+    // A stripe computes the rows in the reach of its own rows too, so its own distances are exact.
+    int reachRows = static_cast<int>(ceil(radius / chamfer_hv)) + 1;
+    buffers->stripes.resize(max(buffers->stripes.size(), max(numberStripes, static_cast<size_t>(1))));
+    parallelStripes(pool, numberStripes, rows, reachRows, [&] (size_t stripeIndex, int beginRow, int endRow)
+    {
+        DistanceTransformBuffers::Stripe & stripeBuffers = buffers->stripes[stripeIndex];
+        if ((beginRow == 0) && (endRow == rows))
+        {
+            distanceMap.setTo(cv::Scalar(static_cast<double>(radius)));
+            chamferRows(edges, distanceMap, 0, tileRowSpans, radius, stripeBuffers.borderRow);
+            return;
+        }
+        int firstRow = max(beginRow - reachRows, 0);
+        int lastRow = min(endRow + reachRows, rows);
+        // The stripes of the same rows have the same heights in every frame, so the buffer is reused.
+        cv::Mat & distances = stripeBuffers.distances;
+        distances.create(lastRow - firstRow, cols, CV_32FC1);
+        distances.setTo(cv::Scalar(static_cast<double>(radius)));
+        chamferRows(edges.rowRange(firstRow, lastRow), distances, firstRow, tileRowSpans, radius,
+                    stripeBuffers.borderRow);
+        cv::Mat stripe = distanceMap.rowRange(beginRow, endRow);
+        distances.rowRange(beginRow - firstRow, endRow - firstRow).copyTo(stripe);
+    });
+}
+
+void distanceGradientField(const cv::Mat & distanceMap, cv::Mat & field,
+                           QThreadPool * pool, size_t numberStripes)
+{
+    CV_Assert(distanceMap.type() == CV_32FC1);
+    CV_Assert(distanceMap.data != field.data);
+
+    int rows = distanceMap.rows, cols = distanceMap.cols;
+    field.create(rows, cols, CV_32FC4);
+    if ((rows == 0) || (cols == 0))
+        return;
+    parallelStripes(pool, numberStripes, rows, 32, [&] (size_t, int beginRow, int endRow)
+    {
+        for (int y = beginRow; y < endRow; ++y)
+        {
+            const float * row = distanceMap.ptr<float>(y);
+            float * fieldRow = field.ptr<float>(y);
+            if (y == 0)
+            {
+                for (int x = 0; x < cols; ++x)
+                {
+                    fieldRow[x * 4] = row[x];
+                    fieldRow[x * 4 + 1] = (x > 0) ? (row[x] - row[x - 1]) : 0.0f;
+                    fieldRow[x * 4 + 2] = 0.0f;
+                    fieldRow[x * 4 + 3] = 0.0f;
+                }
+                continue;
+            }
+            const float * prevRow = distanceMap.ptr<float>(y - 1);
+            fieldRow[0] = row[0];
+            fieldRow[1] = 0.0f;
+            fieldRow[2] = row[0] - prevRow[0];
+            fieldRow[3] = 0.0f;
+            gradientFieldRow(row, prevRow, fieldRow, cols);
+        }
+    });
+}
+
+void exactDistanceTransform(const cv::Mat & edges, cv::Mat & distanceMap, cv::Mat * nearestEdges,
+                            QThreadPool * pool, size_t numberStripes,
+                            DistanceTransformBuffers * buffers)
+{
+    CV_Assert(edges.type() == CV_8UC1);
+
+    int rows = edges.rows, cols = edges.cols;
+    distanceMap.create(rows, cols, CV_32FC1);
+    if (nearestEdges)
+        nearestEdges->create(rows, cols, CV_32SC2);
+    if ((rows == 0) || (cols == 0))
+        return;
+
+    DistanceTransformBuffers localBuffers;
+    if (!buffers)
+        buffers = &localBuffers;
+    buffers->stripes.resize(max(buffers->stripes.size(), max(numberStripes, static_cast<size_t>(1))));
+
+    cv::Mat & nearestRows = buffers->nearestRows;
+    nearestRows.create(rows, cols, CV_32SC1);
+    parallelStripes(pool, numberStripes, cols, exact_min_stripe_cols,
+                    [&] (size_t stripeIndex, int beginCol, int endCol)
+    {
+        nearestColumnEdges(edges, nearestRows, beginCol, endCol, buffers->stripes[stripeIndex].below);
+    });
+
+    // A column with a zero pixel has the nearest zero pixel for every row.
+    bool hasEdges = false;
+    for (int x = 0; (x < cols) && !hasEdges; ++x)
+        hasEdges = (nearestRows.at<int>(0, x) >= 0);
+
+    parallelStripes(pool, numberStripes, rows, exact_min_stripe_rows,
+                    [&] (size_t stripeIndex, int beginRow, int endRow)
+    {
+        DistanceTransformBuffers::Stripe & stripeBuffers = buffers->stripes[stripeIndex];
+        vector<int> & v = stripeBuffers.v;
+        vector<double> & z = stripeBuffers.z;
+        vector<double> & f = stripeBuffers.f;
+        v.resize(static_cast<size_t>(cols));
+        z.resize(static_cast<size_t>(cols + 1));
+        f.resize(static_cast<size_t>(cols));
+        for (int y = beginRow; y < endRow; ++y)
+        {
+            float * d = distanceMap.ptr<float>(y);
+            cv::Vec2i * nearest = nearestEdges ? nearestEdges->ptr<cv::Vec2i>(y) : nullptr;
+            if (!hasEdges)
+            {
+                fill(d, d + cols, static_cast<float>(rows + cols));
+                if (nearest)
+                    fill(nearest, nearest + cols, cv::Vec2i(-1, -1));
+                continue;
+            }
+            envelopeRow(y, nearestRows.ptr<int>(y), cols, d, nearest, v, z, f);
+        }
+    });
+}
@@ -0,0 +1,63 @@
+#ifndef DISTANCETRANSFORM_H
+#define DISTANCETRANSFORM_H
+
+#include <vector>
+
+#include <QThreadPool>
+
+#include <opencv2/core.hpp>
+
+#include "objectmodel.h"
+
+// The working memory of the transforms. A caller which keeps it between the frames doesn't allocate it again,
+// it is used by a single transform at a time.
+struct DistanceTransformBuffers
+{
+    struct Span
+    {
+        int begin;
+        int end;
+    };
+
+    struct Stripe
+    {
+        cv::Mat distances;
+        std::vector<float> borderRow;
+        std::vector<int> below;
+        std::vector<int> v;
+        std::vector<double> z;
+        std::vector<double> f;
+    };
+
+    std::vector<uchar> bandTiles;
+    std::vector<std::vector<Span>> tileRowSpans;
+    cv::Mat nearestRows;
+    std::vector<Stripe> stripes;
+};
+
+// Computes the distances to the zero pixels of the edges image with the same 3x3 chamfer metric
+// as cv::distanceTransform(edges, distanceMap, cv::DIST_L2, 3), but only around the band points.
+// Within the radius of the band points the distances are exact and clamped to the radius,
+// farther pixels hold the radius or an upper bound of their distance.
+// The rows are split into stripes on the pool.
+void narrowBandDistanceTransform(const cv::Mat & edges, cv::Mat & distanceMap,
+                                 const Vectors2f & bandPoints, float radius,
+                                 QThreadPool * pool, size_t numberStripes,
+                                 DistanceTransformBuffers * buffers = nullptr);
+
+// Computes the exact euclidean distances to the zero pixels of the edges image by the separable
+// algorithm of Felzenszwalb and Huttenlocher: the nearest zero pixels of the columns are found first
+// and the lower envelopes of their parabolas along the rows after, both passes in stripes on the pool.
+// If nearestEdges is given, it gets the CV_32SC2 coordinates (x, y) of the nearest zero pixels.
+// Without zero pixels the distances are rows + cols and the coordinates are (-1, -1).
+void exactDistanceTransform(const cv::Mat & edges, cv::Mat & distanceMap, cv::Mat * nearestEdges,
+                            QThreadPool * pool, size_t numberStripes,
+                            DistanceTransformBuffers * buffers = nullptr);
+
+// Packs a CV_32F distance map into a CV_32FC4 field of (distance, d/dx, d/dy, 0) per pixel, where the
+// differences are taken with the left and the upper pixels, as the optimizer takes them. The differences
+// with the pixels out of the image are zero. The rows are split into stripes on the pool.
+void distanceGradientField(const cv::Mat & distanceMap, cv::Mat & field,
+                           QThreadPool * pool, size_t numberStripes);
+
+#endif // DISTANCETRANSFORM_H
@@ -0,0 +1,89 @@
+#include "edgeorientations.h"
+
+#include <cmath>
+#include <qmath.h>
+
+#include <opencv2/imgproc.hpp>
+
+using namespace std;
+using namespace Eigen;
+
+namespace {
+
+// The window over which the structure tensor is summed.
+const int orientation_window_size = 5;
+// The smallest ratio of the eigenvalues difference to the trace of the tensor for a distinct orientation.
+const float min_orientation_coherence = 0.3f;
+
+} // anonymous namespace
+
+void splitEdgeOrientations(const cv::Mat & edges, vector<cv::Mat> & channels, int numberChannels,
+                           EdgeOrientationBuffers * buffers)
+{
+    CV_Assert(edges.type() == CV_8UC1);
+    CV_Assert(numberChannels > 0);
+
+    EdgeOrientationBuffers localBuffers;
+    if (!buffers)
+        buffers = &localBuffers;
+    cv::Mat & gx = buffers->gx;
+    cv::Mat & gy = buffers->gy;
+    cv::Mat & jxx = buffers->jxx;
+    cv::Mat & jyy = buffers->jyy;
+    cv::Mat & jxy = buffers->jxy;
+    cv::Sobel(edges, gx, CV_32F, 1, 0);
+    cv::Sobel(edges, gy, CV_32F, 0, 1);
+    cv::multiply(gx, gx, jxx);
+    cv::multiply(gy, gy, jyy);
+    cv::multiply(gx, gy, jxy);
+    cv::Size window(orientation_window_size, orientation_window_size);
+    cv::boxFilter(jxx, jxx, -1, window);
+    cv::boxFilter(jyy, jyy, -1, window);
+    cv::boxFilter(jxy, jxy, -1, window);
+
+    channels.resize(static_cast<size_t>(numberChannels));
+    for (cv::Mat & channel : channels)
+    {
+        channel.create(edges.size(), CV_8UC1);
+        channel.setTo(cv::Scalar(255));
+    }
+
+    float channelsPerRadian = static_cast<float>(numberChannels / M_PI);
+    vector<uchar *> & channelRows = buffers->channelRows;
+    channelRows.resize(channels.size());
+    for (int y = 0; y < edges.rows; ++y)
+    {
+        const uchar * e = edges.ptr<uchar>(y);
+        const float * xx = jxx.ptr<float>(y);
+        const float * yy = jyy.ptr<float>(y);
+        const float * xy = jxy.ptr<float>(y);
+        for (size_t c = 0; c < channels.size(); ++c)
+            channelRows[c] = channels[c].ptr<uchar>(y);
+        for (int x = 0; x < edges.cols; ++x)
+        {
+            if (e[x] != 0)
+                continue;
+            float a = xx[x] - yy[x], b = 2.0f * xy[x], trace = xx[x] + yy[x];
+            float minDifference = min_orientation_coherence * trace;
+            if ((a * a + b * b) <= (minDifference * minDifference))
+            {
+                for (uchar * row : channelRows)
+                    row[x] = 0;
+                continue;
+            }
+            // The line is across the dominant gradient.
+            float angle = 0.5f * atan2(b, a) + static_cast<float>(M_PI_2);
+            int channel = static_cast<int>(floor(angle * channelsPerRadian));
+            channel = ((channel % numberChannels) + numberChannels) % numberChannels;
+            channelRows[static_cast<size_t>(channel)][x] = 0;
+            channelRows[static_cast<size_t>((channel + 1) % numberChannels)][x] = 0;
+        }
+    }
+}
+
+int edgeOrientationChannel(const Vector2f & direction, int numberChannels)
+{
+    float angle = atan2(direction.y(), direction.x());
+    int channel = static_cast<int>(floor(angle * static_cast<float>(numberChannels / M_PI) + 0.5f));
+    return ((channel % numberChannels) + numberChannels) % numberChannels;
+}
@@ -0,0 +1,31 @@
+#ifndef EDGEORIENTATIONS_H
+#define EDGEORIENTATIONS_H
+
+#include <vector>
+
+#include <Eigen/Eigen>
+
+#include <opencv2/core.hpp>
+
+// The gradients and the structure tensor of splitEdgeOrientations(), which a caller can keep between the frames.
+struct EdgeOrientationBuffers
+{
+    cv::Mat gx;
+    cv::Mat gy;
+    cv::Mat jxx;
+    cv::Mat jyy;
+    cv::Mat jxy;
+    std::vector<uchar *> channelRows;
+};
+
+// Splits the edges (the zero pixels) into channels by the orientation of the edge lines, so a model edge
+// is matched only with the image edges of a similar orientation. The channel c holds the orientations
+// around c * pi / numberChannels, the orientation of a pixel is given by the structure tensor of the edges
+// and goes to the two nearest channels. The pixels without a distinct orientation go to every channel.
+void splitEdgeOrientations(const cv::Mat & edges, std::vector<cv::Mat> & channels, int numberChannels,
+                           EdgeOrientationBuffers * buffers = nullptr);
+
+// The channel of the nearest orientation to a line with the direction in the image.
+int edgeOrientationChannel(const Eigen::Vector2f & direction, int numberChannels);
+
+#endif // EDGEORIENTATIONS_H
@@ -1,5 +1,7 @@
 #include "framehandler.h"
 
+#include <algorithm>
+
 #include <QDebug>
 #include <QThreadPool>
 #include <QTime>
@@ -10,6 +12,9 @@
 #include "texture2grayimageconvertor.h"
 #include "gl/gl_view.h"
 #include "texturereceiver.h"
+#include "frametransform.h"
+#include "trackingworker.h"
+#include "framesource.h"
 
 #include <opencv2/imgproc.hpp>
 
@@ -23,10 +28,20 @@ FrameHandler::FrameHandler():
     m_focalLength(1.0f, 1.0f),
     m_opticalCenter(0.5f, 0.5f),
     m_gl_view(nullptr),
-    m_textureReceiver(nullptr)
+    m_textureReceiver(nullptr),
+    m_zeroCopyMapping(true),
+    m_packedGrayReadback(true),
+    m_asyncReadback(true),
+    m_numberReadbackBuffers(2),
+    m_recordingCompression(RecordingCompression::DeltaZlib)
 {
     m_monitor = QSharedPointer<PerformanceMonitor>::create();
+    m_acquisitionMonitor = QSharedPointer<PerformanceMonitor>::create();
     m_objectEdgesTracker = QSharedPointer<ObjectEdgesTracker>::create(m_monitor);
+    m_liveFrameSource = QSharedPointer<LiveFrameSource>::create();
+    m_trackingWorker = QSharedPointer<TrackingWorker>::create(m_objectEdgesTracker.get(), m_monitor,
+                                                              m_liveFrameSource);
+    m_trackingWorker->start();
 }
 
 QVideoFilterRunnable * FrameHandler::createFilterRunnable()
@@ -140,6 +155,108 @@ void FrameHandler::setTextureReceiver(TextureReceiver * textureReceiver)
     emit textureReceiverChanged();
 }
 
+bool FrameHandler::zeroCopyMapping() const
+{
+    return m_zeroCopyMapping;
+}
+
+void FrameHandler::setZeroCopyMapping(bool zeroCopyMapping)
+{
+    if (m_zeroCopyMapping == zeroCopyMapping)
+        return;
+    m_zeroCopyMapping = zeroCopyMapping;
+    emit zeroCopyMappingChanged();
+}
+
+bool FrameHandler::packedGrayReadback() const
+{
+    return m_packedGrayReadback;
+}
+
+void FrameHandler::setPackedGrayReadback(bool packedGrayReadback)
+{
+    if (m_packedGrayReadback == packedGrayReadback)
+        return;
+    m_packedGrayReadback = packedGrayReadback;
+    emit packedGrayReadbackChanged();
+}
+
+bool FrameHandler::asyncReadback() const
+{
+    return m_asyncReadback;
+}
+
+void FrameHandler::setAsyncReadback(bool asyncReadback)
+{
+    if (m_asyncReadback == asyncReadback)
+        return;
+    m_asyncReadback = asyncReadback;
+    emit asyncReadbackChanged();
+}
+
+int FrameHandler::numberReadbackBuffers() const
+{
+    return m_numberReadbackBuffers;
+}
+
+void FrameHandler::setNumberReadbackBuffers(int numberReadbackBuffers)
+{
+    numberReadbackBuffers = std::max(numberReadbackBuffers, 2);
+    if (m_numberReadbackBuffers == numberReadbackBuffers)
+        return;
+    m_numberReadbackBuffers = numberReadbackBuffers;
+    emit numberReadbackBuffersChanged();
+}
+
+int FrameHandler::countDroppedFrames() const
+{
+    return m_liveFrameSource->countDroppedFrames();
+}
+
+QString FrameHandler::recordingPath() const
+{
+    return m_recordingPath;
+}
+
+void FrameHandler::setRecordingPath(const QString & recordingPath)
+{
+    if (m_recordingPath == recordingPath)
+        return;
+    m_recordingPath = recordingPath;
+    std::shared_ptr<FrameRecorder> recorder;
+    if (!m_recordingPath.isEmpty())
+    {
+        recorder = FrameRecorder::create(m_recordingPath, m_recordingCompression,
+                                         FrameRecorder::getSettings(m_objectEdgesTracker.get()));
+    }
+    m_trackingWorker->setRecorder(recorder);
+    emit recordingPathChanged();
+}
+
+RecordingCompression::Enum FrameHandler::recordingCompression() const
+{
+    return m_recordingCompression;
+}
+
+void FrameHandler::setRecordingCompression(RecordingCompression::Enum recordingCompression)
+{
+    if (m_recordingCompression == recordingCompression)
+        return;
+    m_recordingCompression = recordingCompression;
+    emit recordingCompressionChanged();
+}
+
+QSharedPointer<PerformanceMonitor> FrameHandler::acquisitionMonitor() const
+{
+    return m_acquisitionMonitor;
+}
+
+void FrameHandler::_track(const TrackingFrame & frame)
+{
+    if (m_liveFrameSource->post(frame))
+        emit countDroppedFramesChanged();
+}
+
 void FrameHandler::_setFrameSize(const QSize & frameSize)
 {
     if (frameSize == m_frameSize)
@@ -172,52 +289,48 @@ QVideoFrame FrameHandlerRunnable::run(QVideoFrame * videoFrame,
     cv::Mat frame;
     QVector2D viewScale(1.0f, 1.0f);
 
-    QSharedPointer<PerformanceMonitor> monitor = m_parent->monitor();
+    QSharedPointer<PerformanceMonitor> monitor = m_parent->acquisitionMonitor();
     TextureReceiver * textureReceiver = m_parent->textureReceiver();
 
+    // The arrival of the frame is the closest to its capture that is known for every backend.
+    // The async readback of a texture returns an older frame together with its own time.
+    std::chrono::steady_clock::time_point captureTime = std::chrono::steady_clock::now();
     monitor->start();
     monitor->startTimer("Getting frame");
     GLuint textureId = 0;
     QSize frameSize;
     if (surfaceFormat.handleType() == QAbstractVideoBuffer::NoHandle)
     {
-        Vector2i imageSize(videoFrame->width(), videoFrame->height());
         m_parent->_setFrameSize(videoFrame->size());
-        frame = cv::Mat(imageSize.y(), imageSize.x(), CV_8UC4);
-        if (videoFrame->map(QAbstractVideoBuffer::ReadOnly))
+        if (m_parent->zeroCopyMapping() || _isPlanarYuv(videoFrame->pixelFormat()))
         {
-            std::memcpy(frame.data, videoFrame->bits(),
-                        static_cast<size_t>(imageSize.x() * imageSize.y() * 4));
-            videoFrame->unmap();
+            frame = _readMappedFrame(videoFrame, textureReceiver);
         }
         else
         {
-            qFatal("Coudn't read video frame");
+            Vector2i imageSize(videoFrame->width(), videoFrame->height());
+            frame = cv::Mat(imageSize.y(), imageSize.x(), CV_8UC4);
+            if (videoFrame->map(QAbstractVideoBuffer::ReadOnly))
+            {
+                std::memcpy(frame.data, videoFrame->bits(),
+                            static_cast<size_t>(imageSize.x() * imageSize.y() * 4));
+                videoFrame->unmap();
+            }
+            else
+            {
+                qFatal("Coudn't read video frame");
+            }
+            _transformImage(frame, frame);
+            if (textureReceiver != nullptr)
+                _uploadFrameTexture(frame, textureReceiver, 0);
+            cv::cvtColor(frame, frame, cv::COLOR_BGRA2GRAY);
+            QSize maxSize = m_parent->maxFrameSize();
+            double scale1 = maxSize.width() / static_cast<double>(frame.cols);
+            double scale2 = maxSize.height() / static_cast<double>(frame.rows);
+            double scale = std::min(scale1, scale2);
+            if (scale < 1.0)
+                cv::resize(frame, frame, cv::Size(), scale, scale);
         }
-        _transformImage(frame);
-        if (textureReceiver != nullptr)
-        {
-            if (m_frameTextureId == 0)
-                glGenTextures(1, &m_frameTextureId);
-            glBindTexture(GL_TEXTURE_2D, m_frameTextureId);
-#if defined(__ANDROID__)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, frame.cols, frame.rows,
-                         0, GL_RGBA, GL_UNSIGNED_BYTE, frame.data);
-#else
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_BGRA, frame.cols, frame.rows,
-                         0, GL_BGRA, GL_UNSIGNED_BYTE, frame.data);
-#endif
-            frameSize = QSize(frame.cols, frame.rows);
-            glGenerateMipmap(GL_TEXTURE_2D);
-            textureReceiver->setTextureId(m_frameTextureId, frameSize, 0);
-        }
-        cv::cvtColor(frame, frame, cv::COLOR_BGRA2GRAY);
-        QSize maxSize = m_parent->maxFrameSize();
-        double scale1 = maxSize.width() / static_cast<double>(frame.cols);
-        double scale2 = maxSize.height() / static_cast<double>(frame.rows);
-        double scale = std::min(scale1, scale2);
-        if (scale < 1.0)
-            cv::resize(frame, frame, cv::Size(), scale, scale);
         textureId = m_frameTextureId;
     }
     else if (surfaceFormat.handleType() == QAbstractVideoBuffer::GLTextureHandle)
@@ -235,6 +348,9 @@ QVideoFrame FrameHandlerRunnable::run(QVideoFrame * videoFrame,
 
         if (!m_texture2GrayImageConverter)
             m_texture2GrayImageConverter = QSharedPointer<Texture2GrayImageConvertor>::create();
+        m_texture2GrayImageConverter->setPackedGrayReadback(m_parent->packedGrayReadback());
+        m_texture2GrayImageConverter->setAsyncReadback(m_parent->asyncReadback());
+        m_texture2GrayImageConverter->setNumberReadbackBuffers(m_parent->numberReadbackBuffers());
 
         GL_View * gl_view = m_parent->gl_view();
         QSize viewportSize = ((gl_view != nullptr) &&
@@ -247,6 +363,7 @@ QVideoFrame FrameHandlerRunnable::run(QVideoFrame * videoFrame,
                                                                textureId,
                                                                frameSize, m_parent->maxFrameSize(),
                                                                viewportSize.width() / static_cast<float>(viewportSize.height()),
+                                                               captureTime,
                                                                orientation,
                                                                flipHorizontally);
         }
@@ -255,6 +372,7 @@ QVideoFrame FrameHandlerRunnable::run(QVideoFrame * videoFrame,
             frame = m_texture2GrayImageConverter->read(this,
                                                        textureId,
                                                        frameSize, m_parent->maxFrameSize(),
+                                                       captureTime,
                                                        orientation,
                                                        flipHorizontally);
         }
@@ -265,24 +383,18 @@ QVideoFrame FrameHandlerRunnable::run(QVideoFrame * videoFrame,
     {
         viewScale = QVector2D(std::fabs(viewScale.x()), std::fabs(viewScale.y()));
 
-        QVector2D focalLength = m_parent->focalLength();
-        QVector2D opticalCenter = m_parent->opticalCenter();
-        Vector2i v_imageSize(frame.cols, frame.rows);
-        Vector2f v_focalLength(frame.cols * focalLength.x() * viewScale.x(),
-                               - frame.cols * focalLength.y() * viewScale.x());
-        Vector2f v_opticalCenter(frame.cols * ((opticalCenter.x() - 0.5f) * viewScale.x() + 0.5f),
-                                 frame.rows * ((opticalCenter.y() - 0.5f) * viewScale.y() + 0.5f));
-        ObjectEdgesTracker * objectEdgesTracking = m_parent->objectEdgesTracker();
-        std::shared_ptr<const PinholeCamera> prevCamera = objectEdgesTracking->camera();
-        if (!prevCamera || (prevCamera->imageSize() != v_imageSize) ||
-                ((v_focalLength - prevCamera->pixelFocalLength()).array().sum() > 1e-4f) ||
-                ((v_opticalCenter - prevCamera->pixelOpticalCenter()).array().sum() > 1e-4f))
+        std::shared_ptr<PinholeCamera> camera = PinholeCamera::createFromRelative(Vector2i(frame.cols, frame.rows),
+                                                                                  m_parent->focalLength(),
+                                                                                  m_parent->opticalCenter(),
+                                                                                  viewScale);
+        // The camera travels with the frame, the tracker is switched to it on the tracking thread.
+        if (!m_camera || (m_camera->imageSize() != camera->imageSize()) ||
+                ((camera->pixelFocalLength() - m_camera->pixelFocalLength()).array().sum() > 1e-4f) ||
+                ((camera->pixelOpticalCenter() - m_camera->pixelOpticalCenter()).array().sum() > 1e-4f))
         {
-            objectEdgesTracking->setCamera(std::make_shared<PinholeCamera>(v_imageSize,
-                                                                           v_focalLength,
-                                                                           v_opticalCenter));
+            m_camera = camera;
         }
-        objectEdgesTracking->compute(frame);
+        m_parent->_track({ frame, m_camera, captureTime });
     }
 
     monitor->end();
@@ -291,40 +403,154 @@ QVideoFrame FrameHandlerRunnable::run(QVideoFrame * videoFrame,
     return QVideoFrame(*videoFrame);
 }
 
-void FrameHandlerRunnable::_transformImage(cv::Mat & image) const
+cv::Mat FrameHandlerRunnable::_readMappedFrame(QVideoFrame * videoFrame, TextureReceiver * textureReceiver)
 {
-    int orientation = ((m_parent->orientation() / 90) % 4) * 90;
-    bool transpose = false;
-    bool flipVertically = false, flipHorizontally = m_parent->flipHorizontally();
-    switch (orientation)
+    if (!videoFrame->map(QAbstractVideoBuffer::ReadOnly))
+        qFatal("Coudn't read video frame");
+    // The mapped bits are only wrapped, the single pass over them is the fused
+    // gray conversion, downscale and orientation.
+    cv::Mat mappedFrame;
+    PixelLayout layout;
+    if (_isPlanarYuv(videoFrame->pixelFormat()))
     {
-    case 90:
-        transpose = true;
-        std::swap(flipVertically, flipHorizontally);
-        flipHorizontally = !flipHorizontally;
-        break;
-    case 180:
-        transpose = false;
-        flipHorizontally = !flipHorizontally;
-        flipVertically = !flipVertically;
-        break;
-    case 270:
-        transpose = true;
-        std::swap(flipVertically, flipHorizontally);
-        flipVertically = !flipVertically;
+        // Tracking needs only the luma plane, the chroma planes are read for the texture upload only.
+        mappedFrame = cv::Mat(videoFrame->height(), videoFrame->width(), CV_8UC1,
+                              videoFrame->bits(0), static_cast<size_t>(videoFrame->bytesPerLine(0)));
+        layout = PixelLayout::Gray;
+        if (textureReceiver != nullptr)
+            _uploadYuvFrameTexture(videoFrame, mappedFrame, textureReceiver, m_parent->orientation());
+    }
+    else
+    {
+        mappedFrame = cv::Mat(videoFrame->height(), videoFrame->width(), CV_8UC4,
+                              videoFrame->bits(), static_cast<size_t>(videoFrame->bytesPerLine()));
+        layout = (videoFrame->pixelFormat() == QVideoFrame::Format_ABGR32) ? PixelLayout::RGBA :
+                                                                           PixelLayout::BGRA;
+        if (textureReceiver != nullptr)
+            _uploadFrameTexture(mappedFrame, textureReceiver, m_parent->orientation());
+    }
+    QSize maxSize = m_parent->maxFrameSize();
+    cv::Mat & orientedFrame = _freeFrameBuffer();
+    orientedGrayDownscale(mappedFrame, orientedFrame, layout,
+                          cv::Size(maxSize.width(), maxSize.height()),
+                          ImageOrientation::create(m_parent->orientation(), m_parent->flipHorizontally()),
+                          &m_scaledFrame);
+    videoFrame->unmap();
+    return orientedFrame;
+}
+
+cv::Mat & FrameHandlerRunnable::_freeFrameBuffer()
+{
+    // The tracking thread can still hold one frame in processing and one in the mailbox,
+    // so a buffer is reused only when nobody else references it.
+    for (cv::Mat & buffer : m_frameBuffers)
+    {
+        if ((buffer.u == nullptr) || (buffer.u->refcount == 1))
+            return buffer;
+    }
+    m_frameBuffers[0].release();
+    return m_frameBuffers[0];
+}
+
+void FrameHandlerRunnable::_uploadFrameTexture(const cv::Mat & frame, TextureReceiver * textureReceiver,
+                                               int orientation)
+{
+    cv::Mat data = frame.isContinuous() ? frame : frame.clone();
+    if (m_frameTextureId == 0)
+        glGenTextures(1, &m_frameTextureId);
+    glBindTexture(GL_TEXTURE_2D, m_frameTextureId);
+#if defined(__ANDROID__)
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, data.cols, data.rows,
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data);
+#else
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_BGRA, data.cols, data.rows,
+                 0, GL_BGRA, GL_UNSIGNED_BYTE, data.data);
+#endif
+    glGenerateMipmap(GL_TEXTURE_2D);
+    textureReceiver->setTextureId(m_frameTextureId, QSize(data.cols, data.rows), orientation);
+}
+
+void FrameHandlerRunnable::_uploadYuvFrameTexture(const QVideoFrame * videoFrame, const cv::Mat & luma,
+                                                  TextureReceiver * textureReceiver, int orientation)
+{
+    int width = videoFrame->width(), height = videoFrame->height();
+    QVideoFrame::PixelFormat pixelFormat = videoFrame->pixelFormat();
+    if ((pixelFormat == QVideoFrame::Format_NV12) || (pixelFormat == QVideoFrame::Format_NV21))
+    {
+        cv::Mat chroma(height / 2, width / 2, CV_8UC2,
+                       const_cast<uchar*>(videoFrame->bits(1)),
+                       static_cast<size_t>(videoFrame->bytesPerLine(1)));
+#if defined(__ANDROID__)
+        int code = (pixelFormat == QVideoFrame::Format_NV12) ? cv::COLOR_YUV2RGBA_NV12 : cv::COLOR_YUV2RGBA_NV21;
+#else
+        int code = (pixelFormat == QVideoFrame::Format_NV12) ? cv::COLOR_YUV2BGRA_NV12 : cv::COLOR_YUV2BGRA_NV21;
+#endif
+        cv::cvtColorTwoPlane(luma, chroma, m_colorFrame, code);
+    }
+    else
+    {
+        // cv::cvtColor expects the three planes stacked into one continuous image.
+        m_yuvFrame.create(height + height / 2, width, CV_8UC1);
+        luma.copyTo(m_yuvFrame.rowRange(0, height));
+        uchar * dst = m_yuvFrame.ptr<uchar>(height);
+        size_t chromaWidth = static_cast<size_t>(width / 2);
+        for (int plane = 1; plane < 3; ++plane)
+        {
+            const uchar * src = videoFrame->bits(plane);
+            for (int y = 0; y < height / 2; ++y)
+            {
+                std::memcpy(dst, src + y * videoFrame->bytesPerLine(plane), chromaWidth);
+                dst += chromaWidth;
+            }
+        }
+#if defined(__ANDROID__)
+        int code = (pixelFormat == QVideoFrame::Format_YV12) ? cv::COLOR_YUV2RGBA_YV12 : cv::COLOR_YUV2RGBA_I420;
+#else
+        int code = (pixelFormat == QVideoFrame::Format_YV12) ? cv::COLOR_YUV2BGRA_YV12 : cv::COLOR_YUV2BGRA_I420;
+#endif
+        cv::cvtColor(m_yuvFrame, m_colorFrame, code);
+    }
+    _uploadFrameTexture(m_colorFrame, textureReceiver, orientation);
+}
+
+bool FrameHandlerRunnable::_isPlanarYuv(QVideoFrame::PixelFormat pixelFormat)
+{
+    switch (pixelFormat)
+    {
+    case QVideoFrame::Format_NV12:
+    case QVideoFrame::Format_NV21:
+    case QVideoFrame::Format_YUV420P:
+    case QVideoFrame::Format_YV12:
+        return true;
+    default:
         break;
     }
-    if (transpose)
-        cv::transpose(image, image);
-    if (flipHorizontally)
+    return false;
+}
+
+void FrameHandlerRunnable::_transformImage(const cv::Mat & image, cv::Mat & result) const
+{
+    ImageOrientation orientation = ImageOrientation::create(m_parent->orientation(),
+                                                            m_parent->flipHorizontally());
+    const cv::Mat * source = &image;
+    if (orientation.transpose)
+    {
+        cv::transpose(image, result);
+        source = &result;
+    }
+    if (orientation.flipRows)
     {
-        if (flipVertically)
-            cv::flip(image, image, -1);
+        if (orientation.flipColumns)
+            cv::flip(*source, result, -1);
         else
-            cv::flip(image, image, 0);
+            cv::flip(*source, result, 0);
+    }
+    else if (orientation.flipColumns)
+    {
+        cv::flip(*source, result, 1);
     }
-    else if (flipVertically)
+    else if (!orientation.transpose)
     {
-        cv::flip(image, image, 1);
+        result = image;
     }
 }
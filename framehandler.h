@@ -1,6 +1,9 @@
 #ifndef FRAMEHANDLER_H
 #define FRAMEHANDLER_H
 
+#include <memory>
+#include <array>
+
 #include <QSize>
 #include <QSharedPointer>
 #include <QVideoFrame>
@@ -11,11 +14,17 @@
 
 #include <opencv2/core.hpp>
 
+#include "framerecording.h"
+
 class PerformanceMonitor;
 class ObjectEdgesTracker;
 class Texture2GrayImageConvertor;
 class GL_View;
 class TextureReceiver;
+class PinholeCamera;
+class TrackingWorker;
+class LiveFrameSource;
+struct TrackingFrame;
 
 class FrameHandlerRunnable;
 
@@ -33,6 +42,16 @@ class FrameHandler: public QAbstractVideoFilter
     Q_PROPERTY(GL_View * gl_view READ gl_view WRITE setGl_view NOTIFY gl_viewChanged)
     Q_PROPERTY(TextureReceiver * textureReceiver READ textureReceiver WRITE setTextureReceiver
                NOTIFY textureReceiverChanged)
+    Q_PROPERTY(bool zeroCopyMapping READ zeroCopyMapping WRITE setZeroCopyMapping NOTIFY zeroCopyMappingChanged)
+    Q_PROPERTY(bool packedGrayReadback READ packedGrayReadback WRITE setPackedGrayReadback
+               NOTIFY packedGrayReadbackChanged)
+    Q_PROPERTY(bool asyncReadback READ asyncReadback WRITE setAsyncReadback NOTIFY asyncReadbackChanged)
+    Q_PROPERTY(int numberReadbackBuffers READ numberReadbackBuffers WRITE setNumberReadbackBuffers
+               NOTIFY numberReadbackBuffersChanged)
+    Q_PROPERTY(int countDroppedFrames READ countDroppedFrames NOTIFY countDroppedFramesChanged)
+    Q_PROPERTY(QString recordingPath READ recordingPath WRITE setRecordingPath NOTIFY recordingPathChanged)
+    Q_PROPERTY(RecordingCompression::Enum recordingCompression READ recordingCompression
+               WRITE setRecordingCompression NOTIFY recordingCompressionChanged)
 
 public:
     FrameHandler();
@@ -66,6 +85,31 @@ public:
     TextureReceiver * textureReceiver() const;
     void setTextureReceiver(TextureReceiver * textureReceiver);
 
+    bool zeroCopyMapping() const;
+    void setZeroCopyMapping(bool zeroCopyMapping);
+
+    bool packedGrayReadback() const;
+    void setPackedGrayReadback(bool packedGrayReadback);
+
+    // The async readback delays the frames by numberReadbackBuffers - 1,
+    // the first of them after the start are empty and not tracked.
+    bool asyncReadback() const;
+    void setAsyncReadback(bool asyncReadback);
+
+    int numberReadbackBuffers() const;
+    void setNumberReadbackBuffers(int numberReadbackBuffers);
+
+    int countDroppedFrames() const;
+
+    // Frames are recorded while the path is not empty.
+    QString recordingPath() const;
+    void setRecordingPath(const QString & recordingPath);
+
+    RecordingCompression::Enum recordingCompression() const;
+    void setRecordingCompression(RecordingCompression::Enum recordingCompression);
+
+    QSharedPointer<PerformanceMonitor> acquisitionMonitor() const;
+
 signals:
     void frameSizeChanged();
     void maxFrameSizeChanged();
@@ -75,12 +119,22 @@ signals:
     void opticalCenterChanged();
     void gl_viewChanged();
     void textureReceiverChanged();
+    void zeroCopyMappingChanged();
+    void packedGrayReadbackChanged();
+    void asyncReadbackChanged();
+    void numberReadbackBuffersChanged();
+    void countDroppedFramesChanged();
+    void recordingPathChanged();
+    void recordingCompressionChanged();
 
 private:
     friend class FrameHandlerRunnable;
 
     QSharedPointer<PerformanceMonitor> m_monitor;
+    QSharedPointer<PerformanceMonitor> m_acquisitionMonitor;
     QSharedPointer<ObjectEdgesTracker> m_objectEdgesTracker;
+    QSharedPointer<LiveFrameSource> m_liveFrameSource;
+    QSharedPointer<TrackingWorker> m_trackingWorker;
     QSize m_frameSize;
     QSize m_maxFrameSize;
     int m_orientation;
@@ -92,7 +146,16 @@ private:
     GL_View * m_gl_view;
     TextureReceiver * m_textureReceiver;
 
+    bool m_zeroCopyMapping;
+    bool m_packedGrayReadback;
+    bool m_asyncReadback;
+    int m_numberReadbackBuffers;
+
+    QString m_recordingPath;
+    RecordingCompression::Enum m_recordingCompression;
+
     void _setFrameSize(const QSize & frameSize);
+    void _track(const TrackingFrame & frame);
 };
 
 class FrameHandlerRunnable: public QVideoFilterRunnable, QOpenGLFunctions
@@ -109,7 +172,19 @@ private:
     FrameHandler * m_parent;
     GLuint m_frameTextureId;
     QSharedPointer<Texture2GrayImageConvertor> m_texture2GrayImageConverter;
-    void _transformImage(cv::Mat & image) const;
+    std::array<cv::Mat, 3> m_frameBuffers;
+    std::shared_ptr<PinholeCamera> m_camera;
+    cv::Mat m_yuvFrame;
+    cv::Mat m_colorFrame;
+    cv::Mat m_scaledFrame;
+
+    cv::Mat _readMappedFrame(QVideoFrame * videoFrame, TextureReceiver * textureReceiver);
+    cv::Mat & _freeFrameBuffer();
+    void _uploadFrameTexture(const cv::Mat & frame, TextureReceiver * textureReceiver, int orientation);
+    void _uploadYuvFrameTexture(const QVideoFrame * videoFrame, const cv::Mat & luma,
+                                TextureReceiver * textureReceiver, int orientation);
+    static bool _isPlanarYuv(QVideoFrame::PixelFormat pixelFormat);
+    void _transformImage(const cv::Mat & image, cv::Mat & result) const;
 };
 
 #endif // FRAMEHANDLER_H
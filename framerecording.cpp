@@ -0,0 +1,332 @@
+#include "framerecording.h"
+
+#include <cassert>
+#include <cstring>
+
+#include <QDebug>
+#include <QMetaProperty>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include "pinholecamera.h"
+#include "framesource.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace Eigen;
+using namespace recording;
+
+namespace {
+
+size_t alignedSize(size_t size)
+{
+    return ((size + alignment - 1) / alignment) * alignment;
+}
+
+} // anonymous namespace
+
+shared_ptr<FrameRecorder> FrameRecorder::create(const QString & filePath,
+                                                RecordingCompression::Enum compression,
+                                                const QVariantMap & settings)
+{
+    shared_ptr<FrameRecorder> recorder(new FrameRecorder(compression));
+    recorder->m_file.setFileName(filePath);
+    if (!recorder->m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qCritical() << Q_FUNC_INFO << ": couldn't open" << filePath;
+        return nullptr;
+    }
+    FileHeader header;
+    memcpy(header.magic, fileMagic, sizeof(header.magic));
+    header.version = version;
+    header.reserved = 0;
+    recorder->m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    QByteArray settingsData = QJsonDocument(QJsonObject::fromVariantMap(settings)).toJson(QJsonDocument::Compact);
+    recorder->_writeChunk(ChunkType::Settings, settingsData.constData(), static_cast<size_t>(settingsData.size()));
+    return recorder;
+}
+
+FrameRecorder::FrameRecorder(RecordingCompression::Enum compression):
+    m_compression(compression),
+    m_hasStartTime(false)
+{
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    close();
+}
+
+int FrameRecorder::writeFrame(const TrackingFrame & frame)
+{
+    if (!m_file.isOpen())
+        return -1;
+    assert(frame.image.type() == CV_8UC1);
+    if (!m_hasStartTime)
+    {
+        m_startTime = frame.captureTime;
+        m_hasStartTime = true;
+    }
+
+    FrameHeader header;
+    header.captureTime = duration_cast<nanoseconds>(frame.captureTime - m_startTime).count();
+    header.cols = frame.image.cols;
+    header.rows = frame.image.rows;
+    Vector2f focalLength = frame.camera->pixelFocalLength();
+    Vector2f opticalCenter = frame.camera->pixelOpticalCenter();
+    header.focalLength[0] = focalLength.x();
+    header.focalLength[1] = focalLength.y();
+    header.opticalCenter[0] = opticalCenter.x();
+    header.opticalCenter[1] = opticalCenter.y();
+    header.compression = static_cast<uint32_t>(m_compression);
+    header.reserved[0] = header.reserved[1] = 0;
+
+    size_t imageSize = static_cast<size_t>(frame.image.cols * frame.image.rows);
+    m_deltaBuffer.resize(imageSize);
+    uchar * pixels = m_deltaBuffer.data();
+    for (int y = 0; y < frame.image.rows; ++y)
+    {
+        const uchar * src = frame.image.ptr<uchar>(y);
+        uchar * dst = pixels + y * frame.image.cols;
+        if (m_compression == RecordingCompression::DeltaZlib)
+        {
+            uchar prev = 0;
+            for (int x = 0; x < frame.image.cols; ++x)
+            {
+                dst[x] = static_cast<uchar>(src[x] - prev);
+                prev = src[x];
+            }
+        }
+        else
+        {
+            memcpy(dst, src, static_cast<size_t>(frame.image.cols));
+        }
+    }
+
+    QByteArray compressed;
+    const char * data = reinterpret_cast<const char*>(pixels);
+    size_t dataSize = imageSize;
+    if (m_compression != RecordingCompression::None)
+    {
+        compressed = qCompress(pixels, static_cast<int>(imageSize), 1);
+        data = compressed.constData();
+        dataSize = static_cast<size_t>(compressed.size());
+    }
+    header.dataSize = static_cast<uint32_t>(dataSize);
+
+    IndexEntry entry;
+    entry.frameOffset = _writeChunk(ChunkType::Frame, reinterpret_cast<const char*>(&header), sizeof(header),
+                                    data, dataSize);
+    entry.poseOffset = 0;
+    m_index.push_back(entry);
+    return static_cast<int>(m_index.size()) - 1;
+}
+
+void FrameRecorder::writePose(int frameIndex, const PoseFilter::Pose & pose, TrackingQuality::Enum quality)
+{
+    if (!m_file.isOpen() || (frameIndex < 0) || (frameIndex >= static_cast<int>(m_index.size())))
+        return;
+    PoseRecord record;
+    for (int i = 0; i < 3; ++i)
+        record.position[i] = pose.position(i);
+    record.rotation[0] = pose.rotation.w();
+    record.rotation[1] = pose.rotation.x();
+    record.rotation[2] = pose.rotation.y();
+    record.rotation[3] = pose.rotation.z();
+    record.quality = static_cast<int32_t>(quality);
+    record.reserved = 0;
+    m_index[static_cast<size_t>(frameIndex)].poseOffset = _writeChunk(ChunkType::Pose, reinterpret_cast<const char*>(&record), sizeof(record));
+}
+
+void FrameRecorder::close()
+{
+    if (!m_file.isOpen())
+        return;
+    Trailer trailer;
+    trailer.indexOffset = _writeChunk(ChunkType::Index, reinterpret_cast<const char*>(m_index.data()),
+                                      m_index.size() * sizeof(IndexEntry));
+    memcpy(trailer.magic, indexMagic, sizeof(trailer.magic));
+    m_file.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+    m_file.close();
+}
+
+QVariantMap FrameRecorder::getSettings(const QObject * object)
+{
+    QVariantMap settings;
+    const QMetaObject * metaObject = object->metaObject();
+    for (int i = QObject::staticMetaObject.propertyCount(); i < metaObject->propertyCount(); ++i)
+    {
+        QMetaProperty property = metaObject->property(i);
+        if (property.isWritable())
+            settings.insert(property.name(), property.read(object));
+    }
+    return settings;
+}
+
+uint64_t FrameRecorder::_writeChunk(ChunkType type, const char * data, size_t size,
+                                    const char * extraData, size_t extraSize)
+{
+    static const char padding[alignment] = {};
+    uint64_t offset = static_cast<uint64_t>(m_file.pos());
+    ChunkHeader header;
+    header.type = type;
+    header.reserved = 0;
+    header.size = size + extraSize;
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    m_file.write(data, static_cast<qint64>(size));
+    if (extraSize > 0)
+        m_file.write(extraData, static_cast<qint64>(extraSize));
+    m_file.write(padding, static_cast<qint64>(alignedSize(header.size) - header.size));
+    return offset;
+}
+
+shared_ptr<FrameRecording> FrameRecording::open(const QString & filePath)
+{
+    shared_ptr<FrameRecording> recording(new FrameRecording());
+    recording->m_file.setFileName(filePath);
+    if (!recording->m_file.open(QIODevice::ReadOnly))
+    {
+        qCritical() << Q_FUNC_INFO << ": couldn't open" << filePath;
+        return nullptr;
+    }
+    recording->m_size = static_cast<uint64_t>(recording->m_file.size());
+    if (recording->m_size < sizeof(FileHeader) + sizeof(Trailer))
+        return nullptr;
+    recording->m_data = recording->m_file.map(0, recording->m_file.size());
+    if (recording->m_data == nullptr)
+    {
+        qCritical() << Q_FUNC_INFO << ": couldn't map" << filePath;
+        return nullptr;
+    }
+
+    const FileHeader * header = reinterpret_cast<const FileHeader*>(recording->m_data);
+    const Trailer * trailer = reinterpret_cast<const Trailer*>(recording->m_data + recording->m_size -
+                                                               sizeof(Trailer));
+    if ((memcmp(header->magic, fileMagic, sizeof(fileMagic)) != 0) || (header->version != version) ||
+            (memcmp(trailer->magic, indexMagic, sizeof(indexMagic)) != 0))
+    {
+        qCritical() << Q_FUNC_INFO << ":" << filePath << "is not a recording";
+        return nullptr;
+    }
+
+    uint64_t size = 0;
+    const uchar * settingsData = recording->_chunk(sizeof(FileHeader), ChunkType::Settings, size);
+    if (settingsData != nullptr)
+    {
+        QByteArray json = QByteArray::fromRawData(reinterpret_cast<const char*>(settingsData), static_cast<int>(size));
+        recording->m_settings = QJsonDocument::fromJson(json).object().toVariantMap();
+    }
+    const uchar * indexData = recording->_chunk(trailer->indexOffset, ChunkType::Index, size);
+    if (indexData == nullptr)
+    {
+        qCritical() << Q_FUNC_INFO << ": the index of" << filePath << "is broken";
+        return nullptr;
+    }
+    recording->m_index = reinterpret_cast<const IndexEntry*>(indexData);
+    recording->m_countFrames = static_cast<int>(size / sizeof(IndexEntry));
+    return recording;
+}
+
+FrameRecording::FrameRecording():
+    m_data(nullptr),
+    m_size(0),
+    m_index(nullptr),
+    m_countFrames(0)
+{
+}
+
+FrameRecording::~FrameRecording()
+{
+    if (m_data != nullptr)
+        m_file.unmap(const_cast<uchar*>(m_data));
+}
+
+int FrameRecording::countFrames() const
+{
+    return m_countFrames;
+}
+
+QVariantMap FrameRecording::settings() const
+{
+    return m_settings;
+}
+
+void FrameRecording::applySettings(QObject * object, const QVariantMap & settings)
+{
+    for (auto it = settings.cbegin(); it != settings.cend(); ++it)
+        object->setProperty(it.key().toUtf8().constData(), it.value());
+}
+
+const FrameHeader * FrameRecording::readFrame(int index, cv::Mat & image) const
+{
+    if ((index < 0) || (index >= m_countFrames))
+        return nullptr;
+    uint64_t size = 0;
+    const uchar * data = _chunk(m_index[index].frameOffset, ChunkType::Frame, size);
+    if ((data == nullptr) || (size < sizeof(FrameHeader)))
+        return nullptr;
+    const FrameHeader * header = reinterpret_cast<const FrameHeader*>(data);
+    const uchar * pixels = data + sizeof(FrameHeader);
+    size_t imageSize = static_cast<size_t>(header->cols * header->rows);
+    if (header->dataSize > size - sizeof(FrameHeader))
+        return nullptr;
+
+    if (header->compression == RecordingCompression::None)
+    {
+        if (header->dataSize != imageSize)
+            return nullptr;
+        image = cv::Mat(header->rows, header->cols, CV_8UC1, const_cast<uchar*>(pixels));
+        return header;
+    }
+
+    QByteArray decompressed = qUncompress(pixels, static_cast<int>(header->dataSize));
+    if (static_cast<size_t>(decompressed.size()) != imageSize)
+        return nullptr;
+    image.create(header->rows, header->cols, CV_8UC1);
+    const uchar * src = reinterpret_cast<const uchar*>(decompressed.constData());
+    for (int y = 0; y < header->rows; ++y, src += header->cols)
+    {
+        uchar * dst = image.ptr<uchar>(y);
+        if (header->compression == RecordingCompression::DeltaZlib)
+        {
+            uchar prev = 0;
+            for (int x = 0; x < header->cols; ++x)
+            {
+                prev = static_cast<uchar>(prev + src[x]);
+                dst[x] = prev;
+            }
+        }
+        else
+        {
+            memcpy(dst, src, static_cast<size_t>(header->cols));
+        }
+    }
+    return header;
+}
+
+bool FrameRecording::hasPose(int index) const
+{
+    return (pose(index) != nullptr);
+}
+
+const PoseRecord * FrameRecording::pose(int index) const
+{
+    if ((index < 0) || (index >= m_countFrames) || (m_index[index].poseOffset == 0))
+        return nullptr;
+    uint64_t size = 0;
+    const uchar * data = _chunk(m_index[index].poseOffset, ChunkType::Pose, size);
+    if ((data == nullptr) || (size < sizeof(PoseRecord)))
+        return nullptr;
+    return reinterpret_cast<const PoseRecord*>(data);
+}
+
+const uchar * FrameRecording::_chunk(uint64_t offset, ChunkType type, uint64_t & size) const
+{
+    if ((offset + sizeof(ChunkHeader)) > m_size)
+        return nullptr;
+    const ChunkHeader * header = reinterpret_cast<const ChunkHeader*>(m_data + offset);
+    if ((header->type != type) || (header->size > (m_size - offset - sizeof(ChunkHeader))))
+        return nullptr;
+    size = header->size;
+    return m_data + offset + sizeof(ChunkHeader);
+}
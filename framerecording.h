@@ -0,0 +1,171 @@
+#ifndef FRAMERECORDING_H
+#define FRAMERECORDING_H
+
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <QObject>
+#include <QFile>
+#include <QString>
+#include <QVariantMap>
+
+#include <opencv2/core.hpp>
+
+#include "posefilter.h"
+#include "objectedgestracker.h"
+
+struct TrackingFrame;
+
+struct RecordingCompression
+{
+    Q_GADGET
+public:
+    enum Enum
+    {
+        None,
+        Zlib,
+        DeltaZlib // horizontal differences of the pixels, compressed with zlib
+    };
+    Q_ENUM(Enum)
+};
+
+// The recording is a sequence of chunks aligned to 16 bytes:
+//     file header, settings, (frame, pose)..., index, trailer.
+// A pose can follow a later frame, e.g. with the pipelining of the tracker, it is found by the index.
+// Uncompressed frames are stored row by row without padding, so they can be used
+// directly from the mapped file. All numbers are little-endian.
+namespace recording {
+
+const char fileMagic[8] = { 'T', 'O', 'H', 'R', 'E', 'C', '0', '1' };
+const char indexMagic[8] = { 'T', 'O', 'H', 'R', 'I', 'D', 'X', '1' };
+const std::uint32_t version = 1;
+const std::size_t alignment = 16;
+
+enum class ChunkType: std::uint32_t
+{
+    Settings = 1,
+    Frame = 2,
+    Pose = 3,
+    Index = 4
+};
+
+struct FileHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+};
+
+struct ChunkHeader
+{
+    ChunkType type;
+    std::uint32_t reserved;
+    std::uint64_t size;
+};
+
+struct FrameHeader
+{
+    std::int64_t captureTime; // nanoseconds from the first frame
+    std::int32_t cols;
+    std::int32_t rows;
+    float focalLength[2];
+    float opticalCenter[2];
+    std::uint32_t compression;
+    std::uint32_t dataSize;
+    std::uint32_t reserved[2]; // keeps the pixels aligned
+};
+
+struct PoseRecord
+{
+    double position[3];
+    double rotation[4]; // w, x, y, z
+    std::int32_t quality;
+    std::int32_t reserved;
+};
+
+struct IndexEntry
+{
+    std::uint64_t frameOffset;
+    std::uint64_t poseOffset; // 0 if the pose of the frame is not recorded
+};
+
+struct Trailer
+{
+    std::uint64_t indexOffset;
+    char magic[8];
+};
+
+} // namespace recording
+
+// Writes frames with their cameras and tracking results into a recording.
+class FrameRecorder
+{
+public:
+    // Returns null if the file can't be opened.
+    static std::shared_ptr<FrameRecorder> create(const QString & filePath,
+                                                 RecordingCompression::Enum compression,
+                                                 const QVariantMap & settings);
+
+    ~FrameRecorder();
+
+    // Returns the index of the written frame or -1 if the recorder is closed.
+    int writeFrame(const TrackingFrame & frame);
+    // Sets the pose of the frame with the index which is returned by writeFrame().
+    void writePose(int frameIndex, const PoseFilter::Pose & pose, TrackingQuality::Enum quality);
+
+    void close();
+
+    // Writable properties of the object, except the properties of QObject.
+    static QVariantMap getSettings(const QObject * object);
+
+private:
+    FrameRecorder(RecordingCompression::Enum compression);
+
+    QFile m_file;
+    RecordingCompression::Enum m_compression;
+    std::vector<recording::IndexEntry> m_index;
+    bool m_hasStartTime;
+    std::chrono::steady_clock::time_point m_startTime;
+    std::vector<uchar> m_deltaBuffer;
+
+    std::uint64_t _writeChunk(recording::ChunkType type, const char * data, std::size_t size,
+                              const char * extraData = nullptr, std::size_t extraSize = 0);
+};
+
+// Reads a recording through the mapped file.
+class FrameRecording
+{
+public:
+    // Returns null if the file can't be opened or isn't a recording.
+    static std::shared_ptr<FrameRecording> open(const QString & filePath);
+
+    ~FrameRecording();
+
+    int countFrames() const;
+
+    QVariantMap settings() const;
+    static void applySettings(QObject * object, const QVariantMap & settings);
+
+    // An uncompressed image refers to the mapped file and stays valid while the recording is alive.
+    // Returns the header of the frame or nullptr if the index is invalid.
+    const recording::FrameHeader * readFrame(int index, cv::Mat & image) const;
+
+    bool hasPose(int index) const;
+    const recording::PoseRecord * pose(int index) const;
+
+private:
+    FrameRecording();
+
+    QFile m_file;
+    const uchar * m_data;
+    std::uint64_t m_size;
+    const recording::IndexEntry * m_index;
+    int m_countFrames;
+    QVariantMap m_settings;
+
+    const uchar * _chunk(std::uint64_t offset, recording::ChunkType type, std::uint64_t & size) const;
+};
+
+#endif // FRAMERECORDING_H
@@ -0,0 +1,207 @@
+#include "framesource.h"
+
+#include <QDir>
+#include <QMutexLocker>
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "pinholecamera.h"
+#include "frametransform.h"
+#include "framerecording.h"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+void downscaleGrayFrame(const cv::Mat & gray, cv::Mat & result, const QSize & maxFrameSize)
+{
+    orientedGrayDownscale(gray, result, PixelLayout::Gray,
+                          cv::Size(maxFrameSize.width(), maxFrameSize.height()),
+                          ImageOrientation::create(0, false));
+}
+
+shared_ptr<PinholeCamera> updateCamera(const shared_ptr<PinholeCamera> & camera,
+                                       const cv::Size & imageSize,
+                                       const QVector2D & focalLength,
+                                       const QVector2D & opticalCenter)
+{
+    if (camera && (camera->imageSize() == Eigen::Vector2i(imageSize.width, imageSize.height)))
+        return camera;
+    return PinholeCamera::createFromRelative(Eigen::Vector2i(imageSize.width, imageSize.height),
+                                             focalLength, opticalCenter);
+}
+
+} // anonymous namespace
+
+FrameSource::~FrameSource()
+{
+}
+
+void FrameSource::stop()
+{
+}
+
+LiveFrameSource::LiveFrameSource():
+    m_hasFrame(false),
+    m_stopped(false),
+    m_countDroppedFrames(0)
+{
+}
+
+bool LiveFrameSource::post(const TrackingFrame & frame)
+{
+    QMutexLocker locker(&m_mutex);
+    bool dropped = m_hasFrame;
+    if (dropped)
+        ++m_countDroppedFrames;
+    m_frame = frame;
+    m_hasFrame = true;
+    m_frameCondition.wakeOne();
+    return dropped;
+}
+
+int LiveFrameSource::countDroppedFrames() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_countDroppedFrames;
+}
+
+bool LiveFrameSource::read(TrackingFrame & frame)
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_hasFrame && !m_stopped)
+        m_frameCondition.wait(&m_mutex);
+    if (m_stopped)
+        return false;
+    frame = m_frame;
+    m_frame = TrackingFrame();
+    m_hasFrame = false;
+    return true;
+}
+
+void LiveFrameSource::stop()
+{
+    QMutexLocker locker(&m_mutex);
+    m_stopped = true;
+    m_frameCondition.wakeAll();
+}
+
+VideoFileFrameSource::VideoFileFrameSource(const QString & filePath,
+                                           const QSize & maxFrameSize,
+                                           const QVector2D & focalLength,
+                                           const QVector2D & opticalCenter):
+    m_capture(filePath.toStdString()),
+    m_maxFrameSize(maxFrameSize),
+    m_focalLength(focalLength),
+    m_opticalCenter(opticalCenter),
+    m_startTime(steady_clock::now())
+{
+}
+
+bool VideoFileFrameSource::isOpened() const
+{
+    return m_capture.isOpened();
+}
+
+bool VideoFileFrameSource::read(TrackingFrame & frame)
+{
+    if (!m_capture.read(m_colorFrame) || m_colorFrame.empty())
+        return false;
+    double timestamp = m_capture.get(cv::CAP_PROP_POS_MSEC);
+    if (m_colorFrame.channels() == 1)
+        m_grayFrame = m_colorFrame;
+    else
+        cv::cvtColor(m_colorFrame, m_grayFrame, cv::COLOR_BGR2GRAY);
+    // The frame is passed to another thread, so it gets its own buffer.
+    cv::Mat image;
+    downscaleGrayFrame(m_grayFrame, image, m_maxFrameSize);
+    m_camera = updateCamera(m_camera, image.size(), m_focalLength, m_opticalCenter);
+    frame.image = image;
+    frame.camera = m_camera;
+    frame.captureTime = m_startTime + duration_cast<steady_clock::duration>(duration<double, milli>(timestamp));
+    return true;
+}
+
+ImageDirectoryFrameSource::ImageDirectoryFrameSource(const QString & directoryPath,
+                                                     const QSize & maxFrameSize,
+                                                     const QVector2D & focalLength,
+                                                     const QVector2D & opticalCenter,
+                                                     double frameRate):
+    m_currentIndex(0),
+    m_maxFrameSize(maxFrameSize),
+    m_focalLength(focalLength),
+    m_opticalCenter(opticalCenter),
+    m_frameRate(frameRate),
+    m_startTime(steady_clock::now())
+{
+    QDir directory(directoryPath);
+    QStringList fileNames = directory.entryList({ "*.png", "*.jpg", "*.jpeg", "*.bmp", "*.pgm", "*.tif", "*.tiff" },
+                                                QDir::Files, QDir::Name);
+    for (const QString & fileName : fileNames)
+        m_filePaths.push_back(directory.filePath(fileName));
+}
+
+int ImageDirectoryFrameSource::countFrames() const
+{
+    return m_filePaths.size();
+}
+
+bool ImageDirectoryFrameSource::read(TrackingFrame & frame)
+{
+    cv::Mat gray;
+    while (gray.empty())
+    {
+        if (m_currentIndex >= m_filePaths.size())
+            return false;
+        gray = cv::imread(m_filePaths[m_currentIndex].toStdString(), cv::IMREAD_GRAYSCALE);
+        ++m_currentIndex;
+    }
+    cv::Mat image;
+    downscaleGrayFrame(gray, image, m_maxFrameSize);
+    m_camera = updateCamera(m_camera, image.size(), m_focalLength, m_opticalCenter);
+    frame.image = image;
+    frame.camera = m_camera;
+    frame.captureTime = m_startTime + duration_cast<steady_clock::duration>(
+                duration<double>((m_currentIndex - 1) / m_frameRate));
+    return true;
+}
+
+RecordingFrameSource::RecordingFrameSource(const shared_ptr<FrameRecording> & recording):
+    m_recording(recording),
+    m_nextIndex(0),
+    m_startTime(steady_clock::now())
+{
+}
+
+shared_ptr<FrameRecording> RecordingFrameSource::recording() const
+{
+    return m_recording;
+}
+
+int RecordingFrameSource::currentIndex() const
+{
+    return m_nextIndex - 1;
+}
+
+bool RecordingFrameSource::read(TrackingFrame & frame)
+{
+    cv::Mat image;
+    const recording::FrameHeader * header = m_recording->readFrame(m_nextIndex, image);
+    if (header == nullptr)
+        return false;
+    ++m_nextIndex;
+    Eigen::Vector2i imageSize(header->cols, header->rows);
+    Eigen::Vector2f focalLength(header->focalLength[0], header->focalLength[1]);
+    Eigen::Vector2f opticalCenter(header->opticalCenter[0], header->opticalCenter[1]);
+    if (!m_camera || (m_camera->imageSize() != imageSize) ||
+            (m_camera->pixelFocalLength() != focalLength) || (m_camera->pixelOpticalCenter() != opticalCenter))
+    {
+        m_camera = make_shared<PinholeCamera>(imageSize, focalLength, opticalCenter);
+    }
+    frame.image = image;
+    frame.camera = m_camera;
+    frame.captureTime = m_startTime + duration_cast<steady_clock::duration>(nanoseconds(header->captureTime));
+    return true;
+}
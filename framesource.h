@@ -0,0 +1,136 @@
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include <memory>
+#include <chrono>
+
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QVector2D>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+class PinholeCamera;
+class FrameRecording;
+
+struct TrackingFrame
+{
+    cv::Mat image;
+    std::shared_ptr<PinholeCamera> camera;
+    std::chrono::steady_clock::time_point captureTime;
+};
+
+// A source of gray frames with intrinsics for ObjectEdgesTracker.
+class FrameSource
+{
+public:
+    virtual ~FrameSource();
+
+    // Blocks until the next frame is available. Returns false when the source is finished or stopped.
+    virtual bool read(TrackingFrame & frame) = 0;
+
+    // Interrupts a blocked read().
+    virtual void stop();
+};
+
+// Frames of the camera that are posted by FrameHandler. The source has a single slot,
+// so a frame that was not read yet is replaced by the next one.
+class LiveFrameSource:
+        public FrameSource
+{
+public:
+    LiveFrameSource();
+
+    // Returns true if a frame that was not read yet has been replaced.
+    bool post(const TrackingFrame & frame);
+
+    int countDroppedFrames() const;
+
+    bool read(TrackingFrame & frame) override;
+    void stop() override;
+
+private:
+    mutable QMutex m_mutex;
+    QWaitCondition m_frameCondition;
+    TrackingFrame m_frame;
+    bool m_hasFrame;
+    bool m_stopped;
+    int m_countDroppedFrames;
+};
+
+// Frames of a video file. The capture times follow the timestamps of the video.
+class VideoFileFrameSource:
+        public FrameSource
+{
+public:
+    VideoFileFrameSource(const QString & filePath,
+                         const QSize & maxFrameSize,
+                         const QVector2D & focalLength,
+                         const QVector2D & opticalCenter);
+
+    bool isOpened() const;
+
+    bool read(TrackingFrame & frame) override;
+
+private:
+    cv::VideoCapture m_capture;
+    QSize m_maxFrameSize;
+    QVector2D m_focalLength;
+    QVector2D m_opticalCenter;
+    std::shared_ptr<PinholeCamera> m_camera;
+    std::chrono::steady_clock::time_point m_startTime;
+    cv::Mat m_colorFrame;
+    cv::Mat m_grayFrame;
+};
+
+// Frames of the images of a directory in the order of their names.
+class ImageDirectoryFrameSource:
+        public FrameSource
+{
+public:
+    ImageDirectoryFrameSource(const QString & directoryPath,
+                              const QSize & maxFrameSize,
+                              const QVector2D & focalLength,
+                              const QVector2D & opticalCenter,
+                              double frameRate = 30.0);
+
+    int countFrames() const;
+
+    bool read(TrackingFrame & frame) override;
+
+private:
+    QStringList m_filePaths;
+    int m_currentIndex;
+    QSize m_maxFrameSize;
+    QVector2D m_focalLength;
+    QVector2D m_opticalCenter;
+    double m_frameRate;
+    std::shared_ptr<PinholeCamera> m_camera;
+    std::chrono::steady_clock::time_point m_startTime;
+};
+
+// Frames of a recording, see FrameRecorder. The frames are replayed as fast as they are read.
+class RecordingFrameSource:
+        public FrameSource
+{
+public:
+    RecordingFrameSource(const std::shared_ptr<FrameRecording> & recording);
+
+    std::shared_ptr<FrameRecording> recording() const;
+    // The index of the frame that was read last.
+    int currentIndex() const;
+
+    bool read(TrackingFrame & frame) override;
+
+private:
+    std::shared_ptr<FrameRecording> m_recording;
+    int m_nextIndex;
+    std::shared_ptr<PinholeCamera> m_camera;
+    std::chrono::steady_clock::time_point m_startTime;
+};
+
+#endif // FRAMESOURCE_H
@@ -0,0 +1,256 @@
+#include "frametransform.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// The same fixed point BT.601 weights as cv::cvtColor(*2GRAY) uses for 8-bit images.
+const int gray_shift = 14;
+const int gray_r = 4899;
+const int gray_g = 9617;
+const int gray_b = 1868;
+
+void accumulateGrayRow(const uchar * src, uint32_t * acc, int width, int w0, int w1, int w2)
+{
+    int x = 0;
+#if defined(__AVX2__)
+    const __m256i weights = _mm256_setr_epi16(static_cast<short>(w0), static_cast<short>(w1),
+                                              static_cast<short>(w2), 0,
+                                              static_cast<short>(w0), static_cast<short>(w1),
+                                              static_cast<short>(w2), 0,
+                                              static_cast<short>(w0), static_cast<short>(w1),
+                                              static_cast<short>(w2), 0,
+                                              static_cast<short>(w0), static_cast<short>(w1),
+                                              static_cast<short>(w2), 0);
+    const __m256i round = _mm256_set1_epi32(1 << (gray_shift - 1));
+    for (; x <= width - 8; x += 8)
+    {
+        __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4 + 16));
+        __m256i m0 = _mm256_madd_epi16(_mm256_cvtepu8_epi16(p0), weights);
+        __m256i m1 = _mm256_madd_epi16(_mm256_cvtepu8_epi16(p1), weights);
+        __m256i gray = _mm256_permute4x64_epi64(_mm256_hadd_epi32(m0, m1), _MM_SHUFFLE(3, 1, 2, 0));
+        gray = _mm256_srli_epi32(_mm256_add_epi32(gray, round), gray_shift);
+        __m256i * a = reinterpret_cast<__m256i*>(acc + x);
+        _mm256_storeu_si256(a, _mm256_add_epi32(_mm256_loadu_si256(a), gray));
+    }
+#elif defined(__SSE2__)
+    const __m128i weights = _mm_setr_epi16(static_cast<short>(w0), static_cast<short>(w1),
+                                           static_cast<short>(w2), 0,
+                                           static_cast<short>(w0), static_cast<short>(w1),
+                                           static_cast<short>(w2), 0);
+    const __m128i round = _mm_set1_epi32(1 << (gray_shift - 1));
+    const __m128i zero = _mm_setzero_si128();
+    for (; x <= width - 4; x += 4)
+    {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        __m128 m0 = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpacklo_epi8(p, zero), weights));
+        __m128 m1 = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpackhi_epi8(p, zero), weights));
+        __m128i even = _mm_castps_si128(_mm_shuffle_ps(m0, m1, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i odd = _mm_castps_si128(_mm_shuffle_ps(m0, m1, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m128i gray = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(even, odd), round), gray_shift);
+        __m128i * a = reinterpret_cast<__m128i*>(acc + x);
+        _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), gray));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const uint32x4_t round = vdupq_n_u32(1 << (gray_shift - 1));
+    for (; x <= width - 8; x += 8)
+    {
+        uint8x8x4_t p = vld4_u8(src + x * 4);
+        uint16x8_t c0 = vmovl_u8(p.val[0]);
+        uint16x8_t c1 = vmovl_u8(p.val[1]);
+        uint16x8_t c2 = vmovl_u8(p.val[2]);
+        uint32x4_t lo = vmull_n_u16(vget_low_u16(c0), static_cast<uint16_t>(w0));
+        lo = vmlal_n_u16(lo, vget_low_u16(c1), static_cast<uint16_t>(w1));
+        lo = vmlal_n_u16(lo, vget_low_u16(c2), static_cast<uint16_t>(w2));
+        uint32x4_t hi = vmull_n_u16(vget_high_u16(c0), static_cast<uint16_t>(w0));
+        hi = vmlal_n_u16(hi, vget_high_u16(c1), static_cast<uint16_t>(w1));
+        hi = vmlal_n_u16(hi, vget_high_u16(c2), static_cast<uint16_t>(w2));
+        lo = vshrq_n_u32(vaddq_u32(lo, round), gray_shift);
+        hi = vshrq_n_u32(vaddq_u32(hi, round), gray_shift);
+        vst1q_u32(acc + x, vaddq_u32(vld1q_u32(acc + x), lo));
+        vst1q_u32(acc + x + 4, vaddq_u32(vld1q_u32(acc + x + 4), hi));
+    }
+#endif
+    for (; x < width; ++x)
+    {
+        const uchar * p = src + x * 4;
+        acc[x] += static_cast<uint32_t>((p[0] * w0 + p[1] * w1 + p[2] * w2 +
+                                         (1 << (gray_shift - 1))) >> gray_shift);
+    }
+}
+
+void accumulateLumaRow(const uchar * src, uint32_t * acc, int width)
+{
+    int x = 0;
+#if defined(__AVX2__)
+    for (; x <= width - 8; x += 8)
+    {
+        __m256i luma = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x)));
+        __m256i * a = reinterpret_cast<__m256i*>(acc + x);
+        _mm256_storeu_si256(a, _mm256_add_epi32(_mm256_loadu_si256(a), luma));
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; x <= width - 16; x += 16)
+    {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+        __m128i lo = _mm_unpacklo_epi8(p, zero);
+        __m128i hi = _mm_unpackhi_epi8(p, zero);
+        __m128i * a = reinterpret_cast<__m128i*>(acc + x);
+        _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), _mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_si128(a + 2, _mm_add_epi32(_mm_loadu_si128(a + 2), _mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_si128(a + 3, _mm_add_epi32(_mm_loadu_si128(a + 3), _mm_unpackhi_epi16(hi, zero)));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; x <= width - 8; x += 8)
+    {
+        uint16x8_t luma = vmovl_u8(vld1_u8(src + x));
+        vst1q_u32(acc + x, vaddw_u16(vld1q_u32(acc + x), vget_low_u16(luma)));
+        vst1q_u32(acc + x + 4, vaddw_u16(vld1q_u32(acc + x + 4), vget_high_u16(luma)));
+    }
+#endif
+    for (; x < width; ++x)
+        acc[x] += src[x];
+}
+
+void integerGrayDownscale(const cv::Mat & image, cv::Mat & result, PixelLayout layout,
+                          int factor, const ImageOrientation & orientation)
+{
+    cv::Size scaledSize(image.cols / factor, image.rows / factor);
+    cv::Size resultSize = orientation.transpose ? cv::Size(scaledSize.height, scaledSize.width) : scaledSize;
+    result.create(resultSize, CV_8UC1);
+
+    int w0 = (layout == PixelLayout::BGRA) ? gray_b : gray_r;
+    int w1 = gray_g;
+    int w2 = (layout == PixelLayout::BGRA) ? gray_r : gray_b;
+
+    // A row of the scaled frame is written along a row or a column of the result,
+    // depending on the orientation, so only the start and the stride differ.
+    ptrdiff_t resultStep = static_cast<ptrdiff_t>(result.step);
+    ptrdiff_t pixelStep = orientation.transpose ? (orientation.flipRows ? - resultStep : resultStep) :
+                                                  (orientation.flipColumns ? -1 : 1);
+    auto getResultRow = [&] (int y) -> uchar *
+    {
+        int tx = orientation.transpose ? y : 0;
+        int ty = orientation.transpose ? 0 : y;
+        if (orientation.flipColumns)
+            tx = resultSize.width - 1 - tx;
+        if (orientation.flipRows)
+            ty = resultSize.height - 1 - ty;
+        return result.ptr<uchar>(ty) + tx;
+    };
+
+    int usedWidth = scaledSize.width * factor;
+    vector<uint32_t> acc(static_cast<size_t>(usedWidth));
+    float invArea = 1.0f / static_cast<float>(factor * factor);
+    for (int y = 0; y < scaledSize.height; ++y)
+    {
+        fill(acc.begin(), acc.end(), 0u);
+        for (int i = 0; i < factor; ++i)
+        {
+            if (layout == PixelLayout::Gray)
+                accumulateLumaRow(image.ptr<uchar>(y * factor + i), acc.data(), usedWidth);
+            else
+                accumulateGrayRow(image.ptr<uchar>(y * factor + i), acc.data(), usedWidth, w0, w1, w2);
+        }
+        uchar * dst = getResultRow(y);
+        const uint32_t * a = acc.data();
+        for (int x = 0; x < scaledSize.width; ++x, a += factor, dst += pixelStep)
+        {
+            uint32_t sum = 0;
+            for (int i = 0; i < factor; ++i)
+                sum += a[i];
+            *dst = static_cast<uchar>(static_cast<float>(sum) * invArea + 0.5f);
+        }
+    }
+}
+
+} // anonymous namespace
+
+ImageOrientation ImageOrientation::create(int orientation, bool flipHorizontally)
+{
+    orientation = ((orientation / 90) % 4) * 90;
+    ImageOrientation result { false, flipHorizontally, false };
+    switch (orientation)
+    {
+    case 90:
+        result.transpose = true;
+        swap(result.flipColumns, result.flipRows);
+        result.flipRows = !result.flipRows;
+        break;
+    case 180:
+        result.flipRows = !result.flipRows;
+        result.flipColumns = !result.flipColumns;
+        break;
+    case 270:
+        result.transpose = true;
+        swap(result.flipColumns, result.flipRows);
+        result.flipColumns = !result.flipColumns;
+        break;
+    }
+    return result;
+}
+
+cv::Size getDownscaledSize(const cv::Size & imageSize, const cv::Size & maxImageSize,
+                           const ImageOrientation & orientation)
+{
+    cv::Size maxSize = orientation.transpose ? cv::Size(maxImageSize.height, maxImageSize.width) :
+                                               maxImageSize;
+    if ((maxSize.width <= 0) || (maxSize.height <= 0))
+        return imageSize;
+    double scale = min(maxSize.width / static_cast<double>(imageSize.width),
+                       maxSize.height / static_cast<double>(imageSize.height));
+    if (scale >= 1.0)
+        return imageSize;
+    // The same rounding as cv::resize with a scale instead of a size.
+    return cv::Size(max(cvRound(imageSize.width * scale), 1), max(cvRound(imageSize.height * scale), 1));
+}
+
+int getDownscaleFactor(const cv::Size & imageSize, const cv::Size & maxImageSize,
+                       const ImageOrientation & orientation)
+{
+    cv::Size downscaledSize = getDownscaledSize(imageSize, maxImageSize, orientation);
+    int factorX = imageSize.width / downscaledSize.width;
+    int factorY = imageSize.height / downscaledSize.height;
+    return max(min(factorX, factorY), 1);
+}
+
+void orientedGrayDownscale(const cv::Mat & image, cv::Mat & result,
+                           PixelLayout layout,
+                           const cv::Size & maxImageSize,
+                           const ImageOrientation & orientation,
+                           cv::Mat * scaledBuffer)
+{
+    CV_Assert(image.type() == ((layout == PixelLayout::Gray) ? CV_8UC1 : CV_8UC4));
+
+    cv::Size downscaledSize = getDownscaledSize(image.size(), maxImageSize, orientation);
+    int factor = getDownscaleFactor(image.size(), maxImageSize, orientation);
+    if ((image.cols / factor == downscaledSize.width) && (image.rows / factor == downscaledSize.height))
+    {
+        integerGrayDownscale(image, result, layout, factor, orientation);
+        return;
+    }
+    cv::Mat localBuffer;
+    cv::Mat & scaled = (scaledBuffer != nullptr) ? *scaledBuffer : localBuffer;
+    integerGrayDownscale(image, scaled, layout, factor, orientation);
+    cv::resize(scaled, result,
+               orientation.transpose ? cv::Size(downscaledSize.height, downscaledSize.width) : downscaledSize,
+               0.0, 0.0, cv::INTER_LINEAR);
+}
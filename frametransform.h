@@ -0,0 +1,40 @@
+#ifndef FRAMETRANSFORM_H
+#define FRAMETRANSFORM_H
+
+#include <opencv2/core.hpp>
+
+struct ImageOrientation
+{
+    bool transpose;
+    bool flipRows;
+    bool flipColumns;
+
+    static ImageOrientation create(int orientation, bool flipHorizontally);
+};
+
+enum class PixelLayout
+{
+    BGRA,
+    RGBA,
+    Gray // a single 8-bit channel, e.g. the luma plane of a YUV frame
+};
+
+// The size of the frame scaled down with its aspect to fit into maxImageSize, before the orientation.
+cv::Size getDownscaledSize(const cv::Size & imageSize, const cv::Size & maxImageSize,
+                           const ImageOrientation & orientation);
+
+// The largest integer factor that doesn't reduce the frame below its downscaled size.
+int getDownscaleFactor(const cv::Size & imageSize, const cv::Size & maxImageSize,
+                       const ImageOrientation & orientation);
+
+// Converts a 4-channel or a gray frame to an oriented, area-downscaled gray image in a single pass.
+// The result has the size of cv::resize with the scale that fits the frame into maxImageSize.
+// When this scale is not 1 / integer, the single pass reduces the frame by the integer factor
+// into scaledBuffer and a bilinear resize of the small image gives the rest, which is above 1/2.
+void orientedGrayDownscale(const cv::Mat & image, cv::Mat & result,
+                           PixelLayout layout,
+                           const cv::Size & maxImageSize,
+                           const ImageOrientation & orientation,
+                           cv::Mat * scaledBuffer = nullptr);
+
+#endif // FRAMETRANSFORM_H
@@ -42,5 +42,5 @@ void TestCubeScene::draw(GL_ViewRenderer * view)
     }
     view->glEnable(GL_BLEND);
     view->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    m_cube->draw(view, m_tracker->viewMatrix());
+    m_cube->draw(view, m_tracker->viewMatrix(view->presentationTime()));
 }
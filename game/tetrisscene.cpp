@@ -116,7 +116,7 @@ void TetrisScene::draw(GL_ViewRenderer * view)
 
     m_house->setActivityLevel(std::max(m_house->activityLevel() - 0.1f, 0.0f));
 
-    QMatrix4x4 viewMatrix = m_tracker->viewMatrix();
+    QMatrix4x4 viewMatrix = m_tracker->viewMatrix(view->presentationTime());
 
     if (m_numberRemovalLines != m_game->numberRemovedLines())
     {
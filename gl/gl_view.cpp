@@ -2,6 +2,7 @@
 #include <QFile>
 #include <QOpenGLShaderProgram>
 #include <QQuickWindow>
+#include <QScreen>
 #include <QDebug>
 
 #include "gl_scene.h"
@@ -208,7 +209,8 @@ void GL_View::setOrderRender(int orderRender)
 }
 
 GL_ViewRenderer::GL_ViewRenderer(GL_View * parent):
-    m_parent(parent)
+    m_parent(parent),
+    m_presentationTime(std::chrono::steady_clock::now())
 {
     connect(m_parent->window(), &QQuickWindow::beforeRendering, this,
             &GL_ViewRenderer::_beforeSlotDraw, Qt::DirectConnection);
@@ -251,6 +253,11 @@ QMatrix4x4 GL_ViewRenderer::projectionMatrix() const
     return m_projectionMatrix;
 }
 
+std::chrono::steady_clock::time_point GL_ViewRenderer::presentationTime() const
+{
+    return m_presentationTime;
+}
+
 QMatrix4x4 GL_ViewRenderer::_computeProjectionMatrix() const
 {
     QVector2D focalLength = m_parent->focalLength();
@@ -582,6 +589,12 @@ void GL_ViewRenderer::_draw()
     if (m_parent->viewportSize() != viewportSize())
         m_parent->_setViewportSize(viewportSize());
 
+    QScreen * screen = m_parent->window()->screen();
+    double refreshRate = ((screen != nullptr) && (screen->refreshRate() > 1.0)) ? screen->refreshRate() : 60.0;
+    m_presentationTime = std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(1.0 / refreshRate));
+
     m_projectionMatrix = _computeProjectionMatrix();
 
     QSize viewportSize = this->viewportSize();
@@ -1,6 +1,8 @@
 #ifndef GL_VIEW_H
 #define GL_VIEW_H
 
+#include <chrono>
+
 #include <QObject>
 #include <QOpenGLFunctions>
 #include <QQuickItem>
@@ -156,6 +158,9 @@ public:
 
     QMatrix4x4 projectionMatrix() const;
 
+    // The expected time when the frame that is drawn now appears on the screen.
+    std::chrono::steady_clock::time_point presentationTime() const;
+
 private slots:
     void _beforeSlotDraw();
     void _afterSlotDraw();
@@ -169,6 +174,7 @@ private:
     QMap<int, GL_ShaderMaterialPtr> m_shaderMaterials;
 
     QMatrix4x4 m_projectionMatrix;
+    std::chrono::steady_clock::time_point m_presentationTime;
 
     void _initEmptyTexture();
     void _loadShaders();
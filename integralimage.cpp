@@ -0,0 +1,75 @@
+#include "integralimage.h"
+
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+using namespace std;
+
+void IntegralImage::compute(const cv::Mat & image)
+{
+    CV_Assert(image.type() == CV_8UC1);
+    cv::integral(image, m_sums, CV_32S);
+}
+
+cv::Size IntegralImage::size() const
+{
+    return m_sums.empty() ? cv::Size(0, 0) : cv::Size(m_sums.cols - 1, m_sums.rows - 1);
+}
+
+const cv::Mat & IntegralImage::sums() const
+{
+    return m_sums;
+}
+
+int IntegralImage::sum(const cv::Rect & rect) const
+{
+    const int * top = m_sums.ptr<int>(rect.y);
+    const int * bottom = m_sums.ptr<int>(rect.y + rect.height);
+    return (bottom[rect.x + rect.width] - bottom[rect.x]) - (top[rect.x + rect.width] - top[rect.x]);
+}
+
+double IntegralImage::mean(const cv::Rect & rect) const
+{
+    if (rect.area() == 0)
+        return 0.0;
+    return sum(rect) / static_cast<double>(rect.area());
+}
+
+void IntegralImage::replicatedBoxSums(int y, int radius, int * prefixes, int * sums) const
+{
+    int rows = m_sums.rows - 1, cols = m_sums.cols - 1;
+
+    // The replicated rows beyond the border add more of the first and the last rows,
+    // the prefixes are the sums of the box rows over the columns before x.
+    int extraFirst = max(radius - y, 0);
+    int extraLast = max(y + radius + 1 - rows, 0);
+    const int * top = m_sums.ptr<int>(max(y - radius, 0));
+    const int * bottom = m_sums.ptr<int>(min(y + radius + 1, rows));
+    const int * first0 = m_sums.ptr<int>(0);
+    const int * first1 = m_sums.ptr<int>(1);
+    const int * last0 = m_sums.ptr<int>(rows - 1);
+    const int * last1 = m_sums.ptr<int>(rows);
+    for (int x = 0; x <= cols; ++x)
+    {
+        prefixes[x] = (bottom[x] - top[x]) +
+                extraFirst * (first1[x] - first0[x]) + extraLast * (last1[x] - last0[x]);
+    }
+
+    // The same for the replicated columns.
+    int firstColumn = prefixes[1] - prefixes[0];
+    int lastColumn = prefixes[cols] - prefixes[cols - 1];
+    auto borderSum = [&] (int x) -> int
+    {
+        return (prefixes[min(x + radius + 1, cols)] - prefixes[max(x - radius, 0)]) +
+                max(radius - x, 0) * firstColumn + max(x + radius + 1 - cols, 0) * lastColumn;
+    };
+    int interiorBegin = min(radius, cols);
+    int interiorEnd = max(cols - radius, interiorBegin);
+    for (int x = 0; x < interiorBegin; ++x)
+        sums[x] = borderSum(x);
+    for (int x = interiorBegin; x < interiorEnd; ++x)
+        sums[x] = prefixes[x + radius + 1] - prefixes[x - radius];
+    for (int x = interiorEnd; x < cols; ++x)
+        sums[x] = borderSum(x);
+}
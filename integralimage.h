@@ -0,0 +1,30 @@
+#ifndef INTEGRALIMAGE_H
+#define INTEGRALIMAGE_H
+
+#include <opencv2/core.hpp>
+
+// The summed-area table of an 8-bit image. It is computed once per frame and shared by the box statistics,
+// e.g. the means of the adaptive binarization, so any box sum takes four lookups whatever the size of the box.
+// The sums are 32-bit, which is enough for images up to 8M pixels.
+class IntegralImage
+{
+public:
+    void compute(const cv::Mat & image);
+
+    cv::Size size() const;
+    // The table of (rows + 1) x (cols + 1) sums as given by cv::integral.
+    const cv::Mat & sums() const;
+
+    // The sum and the mean of the pixels of the rectangle within the image.
+    int sum(const cv::Rect & rect) const;
+    double mean(const cv::Rect & rect) const;
+
+    // The sums of the boxes with the side 2 * radius + 1 around the pixels of the row, with the border
+    // replicated as by cv::boxFilter with BORDER_REPLICATE. The prefixes are a buffer of cols + 1 values.
+    void replicatedBoxSums(int y, int radius, int * prefixes, int * sums) const;
+
+private:
+    cv::Mat m_sums;
+};
+
+#endif // INTEGRALIMAGE_H
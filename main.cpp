@@ -11,6 +11,7 @@
 #include "game/tetrisscene.h"
 #include "objectedgestracker.h"
 #include "texturereceiver.h"
+#include "framerecording.h"
 
 void regsiterQmlTypes()
 {
@@ -25,6 +26,7 @@ void regsiterQmlTypes()
     qmlRegisterType<TetrisScene>("mystuffs", 1, 0, "TetrisScene");
     qmlRegisterType<TextureReceiver>("mystuffs", 1, 0, "TextureReceiver");
     qmlRegisterUncreatableType<TrackingQuality>("mystuffs", 1, 0, "TrackingQuality", "It's enum");
+    qmlRegisterUncreatableType<RecordingCompression>("mystuffs", 1, 0, "RecordingCompression", "It's enum");
 }
 
 int main(int argc, char* argv[])
@@ -8,39 +8,86 @@
 #include <qmath.h>
 #include <climits>
 #include <limits>
+#include <cstring>
 
 #include <opencv2/imgproc.hpp>
 #include <opencv2/calib3d.hpp>
 #include <opencv2/highgui.hpp>
 
 #include <QDebug>
+#include <QMutexLocker>
+#include <QtConcurrent/QtConcurrent>
 
 #include "performancemonitor.h"
 #include "pinholecamera.h"
 #include "poseoptimizer.h"
 #include "poseoptimizer2.h"
+#include "distancetransform.h"
+#include "edgeorientations.h"
+#include "tiledimage.h"
+#include "parallelstripes.h"
 
 using namespace std;
 using namespace std::chrono;
 using namespace Eigen;
 
+namespace {
+
+// The largest distance to an edge which is taken into account by the pose optimization.
+const double tracking_max_distance = 30.0;
+
+// The histogram of the automatic threshold takes every 4th pixel of every 4th row.
+const int auto_threshold_sample_step = 4;
+
+// A frame is prepared while another one is pending and the edges of one more can be held by the debug image.
+const size_t max_number_pooled_frames = 3;
+
+// The side of a cell of the model mask is 1 << model_mask_cell_shift pixels.
+const int model_mask_cell_shift = 3;
+
+} // anonymous namespace
+
 ObjectEdgesTracker::ObjectEdgesTracker(const QSharedPointer<PerformanceMonitor> & monitor):
     m_monitor(monitor),
     m_controlPixelDistance(20.0f),
+    m_distanceBandRadius(0.0f),
+    m_numberOrientationChannels(0),
+    m_useCompactDistanceMap(false),
+    m_useTiledDistanceMap(false),
+    m_useDistanceGradients(false),
+    m_useExactDistanceTransform(false),
+    m_useModelGuidedFiltering(false),
+    m_modelProximity(30.0f),
     m_binaryThreshold(50.0),
+    m_autoBinaryThreshold(50.0),
     m_minBlobArea(30.0),
     m_maxBlobCircularity(0.25),
     m_model(ObjectModel::createHouse()),
-    m_trackingQuality(TrackingQuality::Ugly)
+    m_trackingQuality(TrackingQuality::Ugly),
+    m_frameTime(PoseFilter::Clock::now()),
+    m_trackedFrameIndex(-1)
 {
     m_useLaplacian = false;
     m_useAdaptiveBinarization = false;
     m_adaptiveBinarizationWinSize = 31;
     m_useDilate = false;
     m_useErode = false;
+    m_useBlobLabeling = true;
+    m_useRegionOfInterest = false;
+    m_usePosePrediction = true;
+    m_usePipelining = false;
+    m_useAutoThreshold = false;
+    m_numberWorkThreads = QThread::idealThreadCount();
+    m_stageThreadPool.setMaxThreadCount(1);
 
     m_resetCameraPose = Pose(Vector3d(0.0, 10.0, -100.0), Quaterniond(1.0, 0.0, 0.0, 0.0));
     m_poseFilter.reset(m_resetCameraPose);
+
+    // The timer names of the iterations are made once, not in every frame.
+    for (int i = 0; i < 2; ++i)
+        m_tracking1Timers.push_back(QString("    Tracking [1] iter_%1").arg(i).toStdString());
+    for (int i = 0; i < 5; ++i)
+        m_tracking2Timers.push_back(QString("    Tracking [2] iter_%1").arg(i).toStdString());
 }
 
 bool ObjectEdgesTracker::useLaplacian() const
@@ -108,6 +155,85 @@ void ObjectEdgesTracker::setUseErode(bool useErode)
     emit useErodeChanged();
 }
 
+bool ObjectEdgesTracker::useBlobLabeling() const
+{
+    return m_useBlobLabeling;
+}
+
+void ObjectEdgesTracker::setUseBlobLabeling(bool useBlobLabeling)
+{
+    if (m_useBlobLabeling == useBlobLabeling)
+        return;
+    m_useBlobLabeling = useBlobLabeling;
+    emit useBlobLabelingChanged();
+}
+
+bool ObjectEdgesTracker::useRegionOfInterest() const
+{
+    return m_useRegionOfInterest;
+}
+
+void ObjectEdgesTracker::setUseRegionOfInterest(bool useRegionOfInterest)
+{
+    if (m_useRegionOfInterest == useRegionOfInterest)
+        return;
+    m_useRegionOfInterest = useRegionOfInterest;
+    emit useRegionOfInterestChanged();
+}
+
+bool ObjectEdgesTracker::usePosePrediction() const
+{
+    return m_usePosePrediction;
+}
+
+void ObjectEdgesTracker::setUsePosePrediction(bool usePosePrediction)
+{
+    if (m_usePosePrediction == usePosePrediction)
+        return;
+    m_usePosePrediction = usePosePrediction;
+    emit usePosePredictionChanged();
+}
+
+bool ObjectEdgesTracker::usePipelining() const
+{
+    return m_usePipelining;
+}
+
+void ObjectEdgesTracker::setUsePipelining(bool usePipelining)
+{
+    if (m_usePipelining == usePipelining)
+        return;
+    m_usePipelining = usePipelining;
+    emit usePipeliningChanged();
+}
+
+bool ObjectEdgesTracker::useAutoThreshold() const
+{
+    return m_useAutoThreshold;
+}
+
+void ObjectEdgesTracker::setUseAutoThreshold(bool useAutoThreshold)
+{
+    if (m_useAutoThreshold == useAutoThreshold)
+        return;
+    m_useAutoThreshold = useAutoThreshold;
+    emit useAutoThresholdChanged();
+}
+
+int ObjectEdgesTracker::numberWorkThreads() const
+{
+    return m_numberWorkThreads;
+}
+
+void ObjectEdgesTracker::setNumberWorkThreads(int numberWorkThreads)
+{
+    numberWorkThreads = std::max(numberWorkThreads, 1);
+    if (m_numberWorkThreads == numberWorkThreads)
+        return;
+    m_numberWorkThreads = numberWorkThreads;
+    emit numberWorkThreadsChanged();
+}
+
 float ObjectEdgesTracker::controlPixelDistance() const
 {
     return m_controlPixelDistance;
@@ -121,6 +247,112 @@ void ObjectEdgesTracker::setControlPixelDistance(float controlPixelDistance)
     emit controlPixelDistanceChanged();
 }
 
+float ObjectEdgesTracker::distanceBandRadius() const
+{
+    return m_distanceBandRadius;
+}
+
+void ObjectEdgesTracker::setDistanceBandRadius(float distanceBandRadius)
+{
+    distanceBandRadius = std::max(distanceBandRadius, 0.0f);
+    if (m_distanceBandRadius == distanceBandRadius)
+        return;
+    m_distanceBandRadius = distanceBandRadius;
+    emit distanceBandRadiusChanged();
+}
+
+int ObjectEdgesTracker::numberOrientationChannels() const
+{
+    return m_numberOrientationChannels;
+}
+
+void ObjectEdgesTracker::setNumberOrientationChannels(int numberOrientationChannels)
+{
+    numberOrientationChannels = std::max(numberOrientationChannels, 0);
+    if (m_numberOrientationChannels == numberOrientationChannels)
+        return;
+    m_numberOrientationChannels = numberOrientationChannels;
+    emit numberOrientationChannelsChanged();
+}
+
+bool ObjectEdgesTracker::useCompactDistanceMap() const
+{
+    return m_useCompactDistanceMap;
+}
+
+void ObjectEdgesTracker::setUseCompactDistanceMap(bool useCompactDistanceMap)
+{
+    if (m_useCompactDistanceMap == useCompactDistanceMap)
+        return;
+    m_useCompactDistanceMap = useCompactDistanceMap;
+    emit useCompactDistanceMapChanged();
+}
+
+bool ObjectEdgesTracker::useTiledDistanceMap() const
+{
+    return m_useTiledDistanceMap;
+}
+
+void ObjectEdgesTracker::setUseTiledDistanceMap(bool useTiledDistanceMap)
+{
+    if (m_useTiledDistanceMap == useTiledDistanceMap)
+        return;
+    m_useTiledDistanceMap = useTiledDistanceMap;
+    emit useTiledDistanceMapChanged();
+}
+
+bool ObjectEdgesTracker::useDistanceGradients() const
+{
+    return m_useDistanceGradients;
+}
+
+void ObjectEdgesTracker::setUseDistanceGradients(bool useDistanceGradients)
+{
+    if (m_useDistanceGradients == useDistanceGradients)
+        return;
+    m_useDistanceGradients = useDistanceGradients;
+    emit useDistanceGradientsChanged();
+}
+
+bool ObjectEdgesTracker::useExactDistanceTransform() const
+{
+    return m_useExactDistanceTransform;
+}
+
+void ObjectEdgesTracker::setUseExactDistanceTransform(bool useExactDistanceTransform)
+{
+    if (m_useExactDistanceTransform == useExactDistanceTransform)
+        return;
+    m_useExactDistanceTransform = useExactDistanceTransform;
+    emit useExactDistanceTransformChanged();
+}
+
+bool ObjectEdgesTracker::useModelGuidedFiltering() const
+{
+    return m_useModelGuidedFiltering;
+}
+
+void ObjectEdgesTracker::setUseModelGuidedFiltering(bool useModelGuidedFiltering)
+{
+    if (m_useModelGuidedFiltering == useModelGuidedFiltering)
+        return;
+    m_useModelGuidedFiltering = useModelGuidedFiltering;
+    emit useModelGuidedFilteringChanged();
+}
+
+float ObjectEdgesTracker::modelProximity() const
+{
+    return m_modelProximity;
+}
+
+void ObjectEdgesTracker::setModelProximity(float modelProximity)
+{
+    if (m_modelProximity == modelProximity)
+        return;
+    m_modelProximity = modelProximity;
+    emit modelProximityChanged();
+}
+
 double ObjectEdgesTracker::binaryThreshold() const
 {
     return m_binaryThreshold;
@@ -134,6 +366,12 @@ void ObjectEdgesTracker::setBinaryThreshold(double binaryThreshold)
     emit binaryThresholdChanged();
 }
 
+double ObjectEdgesTracker::autoBinaryThreshold() const
+{
+    QMutexLocker locker(&m_poseMutex);
+    return m_autoBinaryThreshold;
+}
+
 double ObjectEdgesTracker::maxBlobCircularity() const
 {
     return m_maxBlobCircularity;
@@ -194,11 +432,116 @@ TrackingQuality::Enum ObjectEdgesTracker::trackingQuality() const
     return m_trackingQuality;
 }
 
+ObjectEdgesTracker::Pose ObjectEdgesTracker::currentPose() const
+{
+    QMutexLocker locker(&m_poseMutex);
+    return m_poseFilter.currentPose();
+}
+
 QMatrix4x4 ObjectEdgesTracker::viewMatrix() const
 {
-    Pose currentCameraPose = m_poseFilter.currentPose();
-    Matrix3f R = currentCameraPose.rotation.conjugate().toRotationMatrix().cast<float>();
-    Vector3f t = - R * currentCameraPose.position.cast<float>();
+    Pose currentCameraPose;
+    {
+        QMutexLocker locker(&m_poseMutex);
+        currentCameraPose = m_poseFilter.currentPose();
+    }
+    return _pose2viewMatrix(currentCameraPose);
+}
+
+QMatrix4x4 ObjectEdgesTracker::viewMatrix(const PoseFilter::TimePoint & time) const
+{
+    if (!m_usePosePrediction)
+        return viewMatrix();
+    Pose cameraPose;
+    {
+        QMutexLocker locker(&m_poseMutex);
+        cameraPose = m_poseFilter.predictedPose(time);
+    }
+    return _pose2viewMatrix(cameraPose);
+}
+
+void ObjectEdgesTracker::compute(cv::Mat image, const PoseFilter::TimePoint & time, int frameIndex)
+{
+    assert(image.channels() == 1);
+    assert(m_camera);
+
+    m_trackedFrameIndex = -1;
+    shared_ptr<PreparedFrame> frame = _acquireFrame();
+    frame->index = frameIndex;
+    frame->time = time;
+    frame->camera = m_camera;
+
+    if (!m_usePipelining)
+    {
+        flush();
+        _prepareFrame(*frame, image, m_poseFilter, m_trackingQuality, m_binaryThreshold);
+        _applyAutoThreshold(*frame);
+        _trackFrame(*frame);
+        return;
+    }
+
+    // The frame is prepared with the poses known before the pending frame is tracked, so the poses
+    // are still computed in the order of the frames, from the poses of the previous frames only.
+    PoseFilter poseFilter = m_poseFilter;
+    TrackingQuality::Enum trackingQuality = m_trackingQuality;
+    double binaryThreshold = m_binaryThreshold;
+    QFuture<void> preparing = QtConcurrent::run(&m_stageThreadPool, [&] () {
+        _prepareFrame(*frame, image, poseFilter, trackingQuality, binaryThreshold);
+    });
+    if (m_pendingFrame)
+        _trackFrame(*m_pendingFrame);
+    preparing.waitForFinished();
+    _applyAutoThreshold(*frame);
+    m_pendingFrame = frame;
+}
+
+shared_ptr<ObjectEdgesTracker::PreparedFrame> ObjectEdgesTracker::_acquireFrame()
+{
+    // The edges of the last tracked frame can be held by the debug image, such a frame is taken
+    // only if there is no other free frame and then its edges get a new buffer.
+    shared_ptr<PreparedFrame> sharedFrame;
+    for (const shared_ptr<PreparedFrame> & frame : m_framePool)
+    {
+        if (frame.use_count() > 1)
+            continue;
+        if (!frame->edges.u || (frame->edges.u->refcount == 1))
+            return frame;
+        if (!sharedFrame)
+            sharedFrame = frame;
+    }
+    if (sharedFrame && (m_framePool.size() >= max_number_pooled_frames))
+    {
+        sharedFrame->edges.release();
+        return sharedFrame;
+    }
+    m_framePool.push_back(make_shared<PreparedFrame>());
+    return m_framePool.back();
+}
+
+void ObjectEdgesTracker::flush()
+{
+    m_trackedFrameIndex = -1;
+    if (!m_pendingFrame)
+        return;
+    _trackFrame(*m_pendingFrame);
+    m_pendingFrame.reset();
+}
+
+int ObjectEdgesTracker::trackedFrameIndex() const
+{
+    return m_trackedFrameIndex;
+}
+
+cv::Mat ObjectEdgesTracker::debugImage() const
+{
+    QMutexLocker locker(&m_poseMutex);
+    return m_debugImage;
+}
+
+QMatrix4x4 ObjectEdgesTracker::_pose2viewMatrix(const Pose & pose)
+{
+    Matrix3f R = pose.rotation.conjugate().toRotationMatrix().cast<float>();
+    Vector3f t = - R * pose.position.cast<float>();
     QMatrix4x4 M;
     for (int i = 0; i < 3; ++i)
     {
@@ -209,136 +552,422 @@ QMatrix4x4 ObjectEdgesTracker::viewMatrix() const
     return M;
 }
 
-void ObjectEdgesTracker::compute(cv::Mat image)
+Matrix<double, 6, 1> ObjectEdgesTracker::_pose2x(const Pose & pose) const
 {
-    assert(image.channels() == 1);
-    assert(m_camera);
+    Matrix<double, 6, 1> x;
+    Quaterniond q = pose.rotation.normalized().conjugate();
+    x.segment<3>(0) = - (q * pose.position);
+    AngleAxisd aa(q);
+    x.segment<3>(3) = aa.axis() * aa.angle();
+    return x;
+}
 
-    if (m_useLaplacian)
+ObjectEdgesTracker::Pose ObjectEdgesTracker::_x2pose(const Matrix<double, 6, 1> & x) const
+{
+    double l = x.segment<3>(3).norm();
+    Quaterniond q = (l > 1e-6) ? Quaterniond(AngleAxisd(l, x.segment<3>(3) / l)).conjugate() :
+                                 Quaterniond(1.0, 0.0, 0.0, 0.0);
+    return Pose(- (q * x.segment<3>(0)), q);
+}
+
+cv::Rect ObjectEdgesTracker::_computeRegionOfInterest(const PreparedFrame & frame, const PoseFilter & poseFilter,
+                                                      TrackingQuality::Enum trackingQuality) const
+{
+    Vector2i imageSize = frame.camera->imageSize();
+    cv::Rect frameRect(0, 0, imageSize.x(), imageSize.y());
+    if (!m_useRegionOfInterest || (trackingQuality == TrackingQuality::Ugly))
+        return frameRect;
+
+    // The optimization starts from the current pose and the object is expected near the predicted pose,
+    // so the region covers the projections of the model at both poses and the reach of the distance map.
+    Vector2f bb_min(numeric_limits<float>::max(), numeric_limits<float>::max());
+    Vector2f bb_max(- numeric_limits<float>::max(), - numeric_limits<float>::max());
+    const Pose poses[2] = { poseFilter.currentPose(), poseFilter.predictedPose(frame.time) };
+    for (const Pose & pose : poses)
     {
-        cv::Mat kernel = (cv::Mat_<float>(3,3) <<
-                          1,  1, 1,
-                          1, -8, 1,
-                          1,  1, 1);
-        cv::filter2D(image, image, CV_32F, kernel);
-        image.convertTo(image, CV_8UC1);
+        Quaterniond q = pose.rotation.normalized().conjugate();
+        Matrix3f R = q.toRotationMatrix().cast<float>();
+        Vector3f t = - (q * pose.position).cast<float>();
+        for (const Vector3f & vertex : m_model.vertices())
+        {
+            Vector3f v = R * vertex + t;
+            if (v.z() < numeric_limits<float>::epsilon())
+                return frameRect;
+            Vector2f p = frame.camera->project(v);
+            bb_min = bb_min.cwiseMin(p);
+            bb_max = bb_max.cwiseMax(p);
+        }
     }
+    float margin = static_cast<float>(tracking_max_distance);
+    bb_min = (bb_min.array() - margin).max(0.0f).floor().matrix();
+    bb_max = (bb_max.array() + margin).min(imageSize.cast<float>().array()).ceil().matrix();
+    if ((bb_min.x() >= bb_max.x()) || (bb_min.y() >= bb_max.y()))
+        return frameRect;
+    return cv::Rect(cv::Point(static_cast<int>(bb_min.x()), static_cast<int>(bb_min.y())),
+                    cv::Point(static_cast<int>(bb_max.x()), static_cast<int>(bb_max.y())));
+}
 
-    cv::Mat binImage;
-    m_monitor->startTimer("Threshold");
-    if (m_useAdaptiveBinarization)
+void ObjectEdgesTracker::_setRegionOfInterest(PreparedFrame & frame, const cv::Rect & regionOfInterest) const
+{
+    frame.regionOfInterest = regionOfInterest;
+    if ((regionOfInterest.width == frame.camera->imageSize().x()) &&
+            (regionOfInterest.height == frame.camera->imageSize().y()))
     {
-        cv::adaptiveThreshold(image, binImage, 255.0,
-                              cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY,
-                              m_adaptiveBinarizationWinSize, m_binaryThreshold - 128.0);
+        frame.regionCamera = frame.camera;
+        return;
     }
+    // The camera of the region sees the same rays, only the image origin is moved to the corner of the region.
+    Vector2f offset(static_cast<float>(regionOfInterest.x), static_cast<float>(regionOfInterest.y));
+    PinholeCamera regionCamera(Vector2i(regionOfInterest.width, regionOfInterest.height),
+                               frame.camera->pixelFocalLength(),
+                               frame.camera->pixelOpticalCenter() - offset);
+    // The camera of the previous region is replaced in place, if nobody else uses it.
+    if (frame.regionCamera && (frame.regionCamera != frame.camera) && (frame.regionCamera.use_count() == 1))
+        *frame.regionCamera = regionCamera;
     else
+        frame.regionCamera = make_shared<PinholeCamera>(regionCamera);
+}
+
+void ObjectEdgesTracker::_prepareFrame(PreparedFrame & frame, cv::Mat image, const PoseFilter & poseFilter,
+                                       TrackingQuality::Enum trackingQuality, double binaryThreshold)
+{
+    _setRegionOfInterest(frame, _computeRegionOfInterest(frame, poseFilter, trackingQuality));
+    image = image(frame.regionOfInterest);
+
+    // The stage can run on its own thread, so the automatic threshold is only kept in the frame here.
+    frame.autoThreshold = m_useAutoThreshold && !m_useAdaptiveBinarization;
+    if (frame.autoThreshold)
     {
-        cv::threshold(image, binImage, m_binaryThreshold, 255.0, cv::THRESH_BINARY);
+        m_monitor->startTimer("Auto threshold");
+        m_preprocessor.sampleHistogram(image, m_useLaplacian, auto_threshold_sample_step, m_histogram);
+        binaryThreshold = m_autoThreshold.update(m_histogram, binaryThreshold);
+        m_monitor->endTimer("Auto threshold");
     }
+    else
+    {
+        // The threshold starts from the histogram of a single frame after the automatic mode is turned on.
+        m_autoThreshold.reset();
+    }
+    frame.binaryThreshold = binaryThreshold;
+
+    cv::Mat & binImage = m_binImage;
+    m_monitor->startTimer("Threshold");
+    Preprocessor::Settings preprocessing;
+    preprocessing.useLaplacian = m_useLaplacian;
+    preprocessing.useAdaptiveBinarization = m_useAdaptiveBinarization;
+    preprocessing.adaptiveBinarizationWinSize = m_adaptiveBinarizationWinSize;
+    preprocessing.threshold = m_useAdaptiveBinarization ? (binaryThreshold - 128.0) : binaryThreshold;
+    preprocessing.useDilate = m_useDilate;
+    m_preprocessor.binarize(image, binImage, preprocessing,
+                            QThreadPool::globalInstance(), static_cast<size_t>(m_numberWorkThreads));
     m_monitor->endTimer("Threshold");
 
-    if (m_useDilate)
+    bool useModelMask = _computeModelMask(frame, poseFilter, trackingQuality);
+    Preprocessor::GetRow getBinaryRow;
+    if (m_useBlobLabeling)
+    {
+        _selectBlobs(binImage, useModelMask);
+        getBinaryRow = [this, &binImage] (int y, uchar * row)
+        {
+            m_blobLabeler.filterRow(binImage, y, row);
+        };
+    }
+    else
     {
-        m_monitor->startTimer("Dilate");
-        cv::dilate(binImage, binImage, cv::getStructuringElement(cv::MORPH_DILATE,
-                                                                 cv::Size(3, 3), cv::Point(1, 1)),
-                   cv::Point(1, 1), 1);
-        m_monitor->startTimer("Dilate");
+        _filterContours(binImage, useModelMask);
+        getBinaryRow = [&binImage] (int y, uchar * row)
+        {
+            memcpy(row, binImage.ptr<uchar>(y), static_cast<size_t>(binImage.cols));
+        };
     }
 
-    m_monitor->startTimer("Find contours");
-    std::vector<std::vector<cv::Point>> contours;
-    cv::findContours(binImage, contours, cv::RETR_LIST, cv::CHAIN_APPROX_NONE);
-    m_monitor->endTimer("Find contours");
+    // The blob filter is applied by the rows, streamed through the erosion and the inversion.
+    m_monitor->startTimer("Edges");
+    m_preprocessor.makeEdges(binImage.size(), frame.edges, m_useErode, getBinaryRow,
+                             QThreadPool::globalInstance(), static_cast<size_t>(m_numberWorkThreads));
+    m_monitor->endTimer("Edges");
 
-    m_monitor->startTimer("Filter contours");
-    for (size_t contourIdx = 0; contourIdx < contours.size(); ++contourIdx)
+    Vectors2f & bandPoints = m_bandPoints;
+    bandPoints.clear();
+    if (m_distanceBandRadius > 0.0f)
     {
-        cv::Moments moms = cv::moments(contours[contourIdx]);
+        // The optimization samples the maps only near the control points. It starts from the current pose,
+        // which is between the poses of the filter when the frame is prepared in the pipeline.
+        const Pose poses[2] = { poseFilter.currentPose(), poseFilter.predictedPose(frame.time) };
+        for (const Pose & pose : poses)
         {
-            double area = moms.m00;
-            if (area < m_minBlobArea)
-            {
-                cv::drawContours(binImage, contours,
-                                 static_cast<int>(contourIdx), cv::Scalar(0), -1);
-                continue;
-            }
+            Matrix<double, 6, 1> x = _pose2x(pose);
+            Matrix3f R = exp_rotationMatrix(x.segment<3>(3).eval()).cast<float>();
+            Vector3f t = x.segment<3>(0).cast<float>();
+            m_model.getControlPoints(frame.regionCamera, m_controlPixelDistance, R, t, m_stageControlPoints);
+            for (const Vector3f & v : m_stageControlPoints)
+                bandPoints.push_back(frame.regionCamera->project((R * v + t).eval()));
         }
-
+    }
+    auto computeDistanceMap = [&] (const cv::Mat & edges, size_t channel, size_t numberStripes)
+    {
+        DistanceTransformBuffers & buffers = m_distanceTransformBuffers[channel];
+        cv::Mat & transformedMap = frame.transformedMaps[channel];
+        cv::Mat & distanceMap = frame.distanceMaps[channel];
+        if (distanceMap.data == transformedMap.data)
+            distanceMap.release();
+        if (m_useExactDistanceTransform)
         {
-            double area = moms.m00;
-            double perimeter = arcLength(contours[contourIdx], true);
-            double ratio = 4.0 * M_PI * area / (perimeter * perimeter);
-            if (ratio > m_maxBlobCircularity)
+            exactDistanceTransform(edges, transformedMap, nullptr, QThreadPool::globalInstance(), numberStripes,
+                                   &buffers);
+        }
+        else if (m_distanceBandRadius > 0.0f)
+        {
+            narrowBandDistanceTransform(edges, transformedMap, bandPoints, m_distanceBandRadius,
+                                        QThreadPool::globalInstance(), numberStripes, &buffers);
+        }
+        else
+        {
+            cv::distanceTransform(edges, transformedMap, cv::DIST_L2, 3);
+        }
+        if (m_useDistanceGradients)
+        {
+            distanceGradientField(transformedMap, distanceMap, QThreadPool::globalInstance(), numberStripes);
+            return;
+        }
+        // The optimizer samples the map at random points, the smaller map stays in the cache.
+        if (m_useTiledDistanceMap)
+        {
+            cv::Mat & tiledMap = m_useCompactDistanceMap ? frame.tiledMaps[channel] : distanceMap;
+            tileImage(transformedMap, tiledMap);
+            if (m_useCompactDistanceMap)
+                tiledMap.convertTo(distanceMap, CV_8U, static_cast<double>(compactDistanceMapScale));
+        }
+        else if (m_useCompactDistanceMap)
+        {
+            transformedMap.convertTo(distanceMap, CV_8U, static_cast<double>(compactDistanceMapScale));
+        }
+        else
+        {
+            distanceMap = transformedMap;
+        }
+    };
+    auto resizeDistanceMaps = [&] (size_t numberMaps)
+    {
+        frame.distanceMaps.resize(numberMaps);
+        frame.transformedMaps.resize(numberMaps);
+        frame.tiledMaps.resize(numberMaps);
+        if (m_distanceTransformBuffers.size() < numberMaps)
+            m_distanceTransformBuffers.resize(numberMaps);
+    };
+
+    if (m_numberOrientationChannels > 0)
+    {
+        m_monitor->startTimer("Edge orientations");
+        splitEdgeOrientations(frame.edges, m_orientationChannels, m_numberOrientationChannels,
+                              &m_edgeOrientationBuffers);
+        m_monitor->endTimer("Edge orientations");
+
+        // The channels are transformed in parallel, each one in a single stripe.
+        m_monitor->startTimer("Distance transfrom [1]");
+        resizeDistanceMaps(m_orientationChannels.size());
+        parallelStripes(QThreadPool::globalInstance(), static_cast<size_t>(m_numberWorkThreads),
+                        static_cast<int>(m_orientationChannels.size()), 1,
+                        [&] (size_t, int beginChannel, int endChannel)
+        {
+            for (int channel = beginChannel; channel < endChannel; ++channel)
             {
-                cv::drawContours(binImage, contours,
-                                 static_cast<int>(contourIdx), cv::Scalar(0), -1);
-                continue;
+                computeDistanceMap(m_orientationChannels[static_cast<size_t>(channel)],
+                                   static_cast<size_t>(channel), 1);
             }
-        }
+        });
     }
-    m_monitor->endTimer("Filter contours");
+    else
+    {
+        m_monitor->startTimer("Distance transfrom [1]");
+        resizeDistanceMaps(1);
+        computeDistanceMap(frame.edges, 0, static_cast<size_t>(m_numberWorkThreads));
+    }
+    m_monitor->endTimer("Distance transfrom [1]");
+}
 
-    if (m_useErode)
+void ObjectEdgesTracker::_applyAutoThreshold(const PreparedFrame & frame)
+{
+    if (!frame.autoThreshold)
+        return;
+    // The manual threshold isn't touched, so it is used again when the automatic mode is turned off.
     {
-        m_monitor->startTimer("Erode");
-        cv::erode(binImage, binImage, cv::getStructuringElement(cv::MORPH_ERODE,
-                                                                cv::Size(3, 3), cv::Point(1, 1)),
-                  cv::Point(1, 1), 1);
-        m_monitor->endTimer("Erode");
+        QMutexLocker locker(&m_poseMutex);
+        if (m_autoBinaryThreshold == frame.binaryThreshold)
+            return;
+        m_autoBinaryThreshold = frame.binaryThreshold;
     }
+    emit autoBinaryThresholdChanged();
+}
 
-    m_monitor->startTimer("Inverting");
-    cv::bitwise_not(binImage, binImage);
-    m_monitor->endTimer("Inverting");
+void ObjectEdgesTracker::_trackFrame(const PreparedFrame & frame)
+{
+    m_frameTime = frame.time;
+    m_trackedFrameIndex = frame.index;
 
-    qDebug() << "Error =" << _tracking1(binImage);
-    m_debugImage = binImage;
+    // The arguments of qDebug() aren't evaluated without the debug output.
+    float error = _tracking1(frame);
+    qDebug() << "Error =" << error;
+    cv::Mat debugImage = frame.edges;
     if (debugEnabled())
     {
         Pose currentCameraPose = m_poseFilter.currentPose();
         m_monitor->startTimer("Debug");
-        cv::cvtColor(m_debugImage, m_debugImage, cv::COLOR_GRAY2BGR);
+        // The area out of the region of interest is shown as an area without edges.
+        debugImage = cv::Mat(frame.camera->imageSize().y(), frame.camera->imageSize().x(),
+                             CV_8UC3, cv::Scalar(255, 255, 255));
+        cv::Mat debugRegion = debugImage(frame.regionOfInterest);
+        cv::cvtColor(frame.edges, debugRegion, cv::COLOR_GRAY2BGR);
+        if (frame.regionCamera != frame.camera)
+            cv::rectangle(debugImage, frame.regionOfInterest, cv::Scalar(255, 0, 0));
         Quaterniond q = currentCameraPose.rotation.normalized().conjugate();
         Matrix3f R = q.toRotationMatrix().cast<float>();
         Vector3f t = - (q * currentCameraPose.position).cast<float>();
-        m_model.draw(m_debugImage, m_camera, R, t);
+        m_model.draw(debugImage, frame.camera, R, t);
         m_monitor->endTimer("Debug");
     }
+    QMutexLocker locker(&m_poseMutex);
+    m_debugImage = debugImage;
 }
 
-cv::Mat ObjectEdgesTracker::debugImage() const
+bool ObjectEdgesTracker::_computeModelMask(const PreparedFrame & frame, const PoseFilter & poseFilter,
+                                           TrackingQuality::Enum trackingQuality)
 {
-    return m_debugImage;
+    if (!m_useModelGuidedFiltering || (trackingQuality == TrackingQuality::Ugly))
+        return false;
+
+    m_monitor->startTimer("Model mask");
+    int width = frame.regionOfInterest.width, height = frame.regionOfInterest.height;
+    int cellSize = 1 << model_mask_cell_shift;
+    m_modelMask.create((height + cellSize - 1) >> model_mask_cell_shift,
+                       (width + cellSize - 1) >> model_mask_cell_shift, CV_8UC1);
+    m_modelMask.setTo(cv::Scalar(0));
+
+    // The control points follow the visible model edges, the cells near them are marked at the current pose,
+    // where the optimization starts, and at the predicted one, where the object is expected.
+    float radius = max(m_modelProximity, m_controlPixelDistance * 0.5f);
+    const Pose poses[2] = { poseFilter.currentPose(), poseFilter.predictedPose(frame.time) };
+    for (const Pose & pose : poses)
+    {
+        Matrix<double, 6, 1> x = _pose2x(pose);
+        Matrix3f R = exp_rotationMatrix(x.segment<3>(3).eval()).cast<float>();
+        Vector3f t = x.segment<3>(0).cast<float>();
+        m_model.getControlPoints(frame.regionCamera, m_controlPixelDistance, R, t, m_stageControlPoints);
+        for (const Vector3f & v : m_stageControlPoints)
+        {
+            Vector2f p = frame.regionCamera->project((R * v + t).eval());
+            int x0 = max(static_cast<int>(floor(p.x() - radius)), 0);
+            int y0 = max(static_cast<int>(floor(p.y() - radius)), 0);
+            int x1 = min(static_cast<int>(ceil(p.x() + radius)), width - 1);
+            int y1 = min(static_cast<int>(ceil(p.y() + radius)), height - 1);
+            if ((x0 > x1) || (y0 > y1))
+                continue;
+            x0 >>= model_mask_cell_shift;
+            y0 >>= model_mask_cell_shift;
+            x1 >>= model_mask_cell_shift;
+            y1 >>= model_mask_cell_shift;
+            m_modelMask(cv::Rect(x0, y0, x1 - x0 + 1, y1 - y0 + 1)).setTo(cv::Scalar(255));
+        }
+    }
+    m_monitor->endTimer("Model mask");
+    return true;
 }
 
-Matrix<double, 6, 1> ObjectEdgesTracker::_pose2x(const Pose & pose) const
+void ObjectEdgesTracker::_selectBlobs(const cv::Mat & binImage, bool useModelMask)
 {
-    Matrix<double, 6, 1> x;
-    Quaterniond q = pose.rotation.normalized().conjugate();
-    x.segment<3>(0) = - (q * pose.position);
-    AngleAxisd aa(q);
-    x.segment<3>(3) = aa.axis() * aa.angle();
-    return x;
+    m_monitor->startTimer("Label blobs");
+    m_blobLabeler.label(binImage);
+    m_monitor->endTimer("Label blobs");
+
+    m_monitor->startTimer("Filter contours");
+    const vector<BlobLabeler::Blob> & blobs = m_blobLabeler.blobs();
+    const vector<BlobLabeler::Hole> & holes = m_blobLabeler.holes();
+    if (useModelMask)
+        m_blobLabeler.markBlobsInMask(m_modelMask, model_mask_cell_shift, m_modelBlobs, m_modelHoles);
+    vector<uchar> & keepBlobs = m_keepBlobs;
+    keepBlobs.resize(blobs.size());
+    for (size_t blobIdx = 0; blobIdx < blobs.size(); ++blobIdx)
+    {
+        const BlobLabeler::Blob & blob = blobs[blobIdx];
+        keepBlobs[blobIdx] = ((blob.area < m_minBlobArea) ||
+                              (blob.circularity() > m_maxBlobCircularity) ||
+                              (useModelMask && (m_modelBlobs[blobIdx] == 0))) ? 0 : 1;
+    }
+    // The hole contours are filtered as the contours of cv::findContours(RETR_LIST) were,
+    // a cleared hole takes the ring of its blob around it too.
+    vector<uchar> & keepHoles = m_keepHoles;
+    keepHoles.resize(holes.size());
+    for (size_t holeIdx = 0; holeIdx < holes.size(); ++holeIdx)
+    {
+        const BlobLabeler::Hole & hole = holes[holeIdx];
+        keepHoles[holeIdx] = ((hole.area < m_minBlobArea) ||
+                              (hole.circularity() > m_maxBlobCircularity) ||
+                              (useModelMask && (m_modelHoles[holeIdx] == 0))) ? 0 : 1;
+    }
+    m_blobLabeler.selectBlobs(keepBlobs, keepHoles);
+    m_monitor->endTimer("Filter contours");
 }
 
-ObjectEdgesTracker::Pose ObjectEdgesTracker::_x2pose(const Matrix<double, 6, 1> & x) const
+void ObjectEdgesTracker::_filterContours(cv::Mat & binImage, bool useModelMask)
 {
-    double l = x.segment<3>(3).norm();
-    Quaterniond q = (l > 1e-6) ? Quaterniond(AngleAxisd(l, x.segment<3>(3) / l)).conjugate() :
-                                 Quaterniond(1.0, 0.0, 0.0, 0.0);
-    return Pose(- (q * x.segment<3>(0)), q);
+    m_monitor->startTimer("Find contours");
+    std::vector<std::vector<cv::Point>> & contours = m_contours;
+    cv::findContours(binImage, contours, cv::RETR_LIST, cv::CHAIN_APPROX_NONE);
+    m_monitor->endTimer("Find contours");
+
+    m_monitor->startTimer("Filter contours");
+    for (size_t contourIdx = 0; contourIdx < contours.size(); ++contourIdx)
+    {
+        cv::Moments moms = cv::moments(contours[contourIdx]);
+        {
+            double area = moms.m00;
+            if (area < m_minBlobArea)
+            {
+                cv::drawContours(binImage, contours,
+                                 static_cast<int>(contourIdx), cv::Scalar(0), -1);
+                continue;
+            }
+        }
+
+        {
+            double area = moms.m00;
+            double perimeter = arcLength(contours[contourIdx], true);
+            double ratio = 4.0 * M_PI * area / (perimeter * perimeter);
+            if (ratio > m_maxBlobCircularity)
+            {
+                cv::drawContours(binImage, contours,
+                                 static_cast<int>(contourIdx), cv::Scalar(0), -1);
+                continue;
+            }
+        }
+
+        // The edges of a blob are on its contour, so the blob is kept if its contour comes near the model.
+        if (useModelMask)
+        {
+            bool nearModel = false;
+            for (const cv::Point & p : contours[contourIdx])
+            {
+                if (m_modelMask.at<uchar>(p.y >> model_mask_cell_shift, p.x >> model_mask_cell_shift) != 0)
+                {
+                    nearModel = true;
+                    break;
+                }
+            }
+            if (!nearModel)
+            {
+                cv::drawContours(binImage, contours,
+                                 static_cast<int>(contourIdx), cv::Scalar(0), -1);
+                continue;
+            }
+        }
+    }
+    m_monitor->endTimer("Filter contours");
 }
 
-float ObjectEdgesTracker::_tracking1(const cv::Mat & edges)
+float ObjectEdgesTracker::_tracking1(const PreparedFrame & frame)
 {
-    m_monitor->startTimer("Distance transfrom [1]");
-    cv::Mat distancesMap;
-    cv::distanceTransform(edges, distancesMap, cv::DIST_L2, 3);
-    m_monitor->endTimer("Distance transfrom [1]");
-
-    Vectors3f controlModelPoints;
+    Vectors3f & controlModelPoints = m_controlModelPoints;
+    controlModelPoints.clear();
     float E = numeric_limits<float>::max();
 
     Matrix<double, 6, 1> x = _pose2x(m_poseFilter.currentPose());
@@ -352,27 +981,41 @@ float ObjectEdgesTracker::_tracking1(const cv::Mat & edges)
 
     for (int i = 0; i < 2; ++i)
     {
-        string iterName = QString("    Tracking [1] iter_%1").arg(i).toStdString();
+        const string & iterName = m_tracking1Timers[static_cast<size_t>(i)];
         m_monitor->startTimer(iterName);
-        controlModelPoints = m_model.getControlPoints(m_camera, m_controlPixelDistance, R, t);
+        // Every control point is matched with the edges of the orientation of its model edge.
+        Vectors2f & imageDirections = m_imageDirections;
+        int numberChannels = static_cast<int>(frame.distanceMaps.size());
+        m_model.getControlPoints(frame.regionCamera, m_controlPixelDistance, R, t, controlModelPoints,
+                                 (numberChannels > 1) ? &imageDirections : nullptr);
         if (controlModelPoints.size() < 4)
         {
             E = numeric_limits<float>::max();
             break;
         }
+        vector<int> & distanceMapIndices = m_distanceMapIndices;
+        distanceMapIndices.assign(controlModelPoints.size(), 0);
+        if (numberChannels > 1)
+        {
+            for (size_t j = 0; j < imageDirections.size(); ++j)
+                distanceMapIndices[j] = edgeOrientationChannel(imageDirections[j], numberChannels);
+        }
 
         if (m_poseFilter.currentStep() > 1)
         {
             E = static_cast<float>(optimize_pose(x,
-                              QThreadPool::globalInstance(), QThread::idealThreadCount(),
-                              distancesMap, m_camera, controlModelPoints, 30.0, 10,
-                                                 0.5 / 3.0, prevViewPostition));
+                              QThreadPool::globalInstance(), static_cast<size_t>(m_numberWorkThreads),
+                              frame.distanceMaps, distanceMapIndices,
+                              frame.regionCamera, controlModelPoints, tracking_max_distance, 10,
+                                                 0.5 / 3.0, prevViewPostition, &m_poseOptimizerBuffers));
         }
         else
         {
             E = static_cast<float>(optimize_pose(x,
-                              QThreadPool::globalInstance(), QThread::idealThreadCount(),
-                              distancesMap, m_camera, controlModelPoints, 30.0, 10));
+                              QThreadPool::globalInstance(), static_cast<size_t>(m_numberWorkThreads),
+                              frame.distanceMaps, distanceMapIndices,
+                              frame.regionCamera, controlModelPoints, tracking_max_distance, 10,
+                                                 -1.0, Vector3d::Zero(), &m_poseOptimizerBuffers));
         }
 
         R = exp_rotationMatrix(x.segment<3>(3).eval()).cast<float>();
@@ -387,7 +1030,7 @@ float ObjectEdgesTracker::_tracking1(const cv::Mat & edges)
 
     for (const Vector3f & v : controlModelPoints)
     {
-        Vector2f p = m_camera->project((R * v + t).eval());
+        Vector2f p = frame.regionCamera->project((R * v + t).eval());
         if (p.x() < bb_min.x())
             bb_min.x() = p.x();
         if (p.y() < bb_min.y())
@@ -403,41 +1046,75 @@ float ObjectEdgesTracker::_tracking1(const cv::Mat & edges)
     _setTrackingQuality(_error2quality(E));
     if (m_trackingQuality == TrackingQuality::Ugly)
     {
-        m_poseFilter.reset(m_resetCameraPose);
+        QMutexLocker locker(&m_poseMutex);
+        m_poseFilter.reset(m_resetCameraPose, m_frameTime);
     }
     else
     {
         Vector3d pose = _x2pose(x).position;
         qDebug().noquote() << QString("pose = %1 %2 %3").arg(pose.x()).arg(pose.y()).arg(pose.z());
-        m_poseFilter.next(_x2pose(x));
+        QMutexLocker locker(&m_poseMutex);
+        m_poseFilter.next(_x2pose(x), m_frameTime);
     }
 
     return E;
 }
 
-float ObjectEdgesTracker::_tracking2(const cv::Mat & edges)
+float ObjectEdgesTracker::_tracking2(const PreparedFrame & frame)
 {
+    const cv::Mat & edges = frame.edges;
     m_monitor->startTimer("Distance transfrom [2]");
-    cv::Mat distancesMap, labels;
-    cv::distanceTransform(edges, distancesMap, labels, cv::DIST_L2, 3, cv::DIST_LABEL_PIXEL);
+    cv::Mat & distancesMap = m_trackingDistances;
+    cv::Mat & labels = m_trackingLabels;
+    cv::Mat & nearestEdges = m_nearestEdges;
+    if (m_useExactDistanceTransform)
+    {
+        // The exact transform gives the nearest edge points themselves, they need no index.
+        exactDistanceTransform(edges, distancesMap, &nearestEdges,
+                               QThreadPool::globalInstance(), static_cast<size_t>(m_numberWorkThreads),
+                               &m_trackingDistanceBuffers);
+    }
+    else
+    {
+        cv::distanceTransform(edges, distancesMap, labels, cv::DIST_L2, 3, cv::DIST_LABEL_PIXEL);
+    }
     m_monitor->endTimer("Distance transfrom [2]");
 
-    m_monitor->startTimer("Indexing [2]");
-    std::unordered_map<int, Vector2i> index2point;
-    cv::Point2i p;
-    for (p.y = 0; p.y < edges.rows; ++p.y)
+    // Every zero pixel gets its own label, the labels go from 1 up to the number of the zero pixels.
+    vector<Vector2i> & labelPoints = m_labelPoints;
+    if (!m_useExactDistanceTransform)
     {
-        const uchar * e_ptr = edges.ptr<uchar>(p.y, 0);
-        const int * l_ptr = labels.ptr<int>(p.y, 0);
-        for (p.x = 0; p.x < edges.cols; ++p.x)
+        m_monitor->startTimer("Indexing [2]");
+        labelPoints.resize(static_cast<size_t>(edges.rows) * static_cast<size_t>(edges.cols) + 1);
+        cv::Point2i p;
+        for (p.y = 0; p.y < edges.rows; ++p.y)
         {
-            if (e_ptr[p.x] == 0)
+            const uchar * e_ptr = edges.ptr<uchar>(p.y, 0);
+            const int * l_ptr = labels.ptr<int>(p.y, 0);
+            for (p.x = 0; p.x < edges.cols; ++p.x)
             {
-                index2point[l_ptr[p.x]] = Vector2i(p.x, p.y);
+                if (e_ptr[p.x] == 0)
+                {
+                    labelPoints[static_cast<size_t>(l_ptr[p.x])] = Vector2i(p.x, p.y);
+                }
             }
         }
+        m_monitor->endTimer("Indexing [2]");
     }
-    m_monitor->endTimer("Indexing [2]");
+    auto findNearestEdge = [&] (const Vector2i & point, Vector2i & edgePoint) -> bool
+    {
+        if (m_useExactDistanceTransform)
+        {
+            const cv::Vec2i & nearest = nearestEdges.at<cv::Vec2i>(point.y(), point.x());
+            edgePoint = Vector2i(nearest[0], nearest[1]);
+            return nearest[0] >= 0;
+        }
+        int label = labels.at<int>(point.y(), point.x());
+        if ((label <= 0) || (static_cast<size_t>(label) >= labelPoints.size()))
+            return false;
+        edgePoint = labelPoints[static_cast<size_t>(label)];
+        return true;
+    };
 
     Vectors3f controlModelPoints;
     Vectors2f imagePoints;
@@ -450,26 +1127,26 @@ float ObjectEdgesTracker::_tracking2(const cv::Mat & edges)
 
     m_monitor->startTimer("Tracking [2]");
 
-    tie(controlModelPoints, imagePoints) = m_model.getControlAndImagePoints(m_camera, m_controlPixelDistance, R, t);
+    tie(controlModelPoints, imagePoints) = m_model.getControlAndImagePoints(frame.regionCamera, m_controlPixelDistance, R, t);
 
     for (size_t j = 0; j < controlModelPoints.size(); )
     {
         Vector2f & imagePoint = imagePoints[j];
         Vector2i imagePoint_i = imagePoint.cast<int>();
-        auto it = index2point.find(labels.at<int>(imagePoint_i.y(), imagePoint_i.x()));
-        if (it == index2point.cend())
+        Vector2i edgePoint;
+        if (!findNearestEdge(imagePoint_i, edgePoint))
         {
             controlModelPoints.erase(controlModelPoints.begin() + j);
             imagePoints.erase(imagePoints.begin() + j);
             continue;
         }
-        imagePoints[j] = it->second.cast<float>();
+        imagePoints[j] = edgePoint.cast<float>();
         ++j;
     }
 
     for (int i = 0; i < 5; ++i)
     {
-        string iterName = QString("    Tracking [2] iter_%1").arg(i).toStdString();
+        const string & iterName = m_tracking2Timers[static_cast<size_t>(i)];
         m_monitor->startTimer(iterName);
 
         if (controlModelPoints.size() < 4)
@@ -478,7 +1155,7 @@ float ObjectEdgesTracker::_tracking2(const cv::Mat & edges)
             break;
         }
 
-        E = optimize_pose(x, m_camera, controlModelPoints, imagePoints, 150.0f, 6);
+        E = optimize_pose(x, frame.regionCamera, controlModelPoints, imagePoints, 150.0f, 6);
 
         R = exp_rotationMatrix(x.segment<3>(3).eval()).cast<float>();
         t = x.segment<3>(0).cast<float>();
@@ -493,7 +1170,7 @@ float ObjectEdgesTracker::_tracking2(const cv::Mat & edges)
 
     for (const Vector3f & v : controlModelPoints)
     {
-        Vector2f p = m_camera->project((R * v + t).eval());
+        Vector2f p = frame.regionCamera->project((R * v + t).eval());
         if (p.x() < bb_min.x())
             bb_min.x() = p.x();
         if (p.y() < bb_min.y())
@@ -507,13 +1184,14 @@ float ObjectEdgesTracker::_tracking2(const cv::Mat & edges)
     if (area < 100.0f)
         E = numeric_limits<float>::max();
     _setTrackingQuality(_error2quality(E));
+    QMutexLocker locker(&m_poseMutex);
     if (m_trackingQuality == TrackingQuality::Ugly)
     {
-        m_poseFilter.reset(m_resetCameraPose);
+        m_poseFilter.reset(m_resetCameraPose, m_frameTime);
     }
     else
     {
-        m_poseFilter.next(_x2pose(x));
+        m_poseFilter.next(_x2pose(x), m_frameTime);
     }
 
     return E;
@@ -2,12 +2,14 @@
 #define OBJECTEDGESTRACKER_H
 
 #include <memory>
-#include <unordered_map>
+#include <string>
 #include <tuple>
 
 #include <QVector2D>
 #include <QMatrix4x4>
 #include <QSharedPointer>
+#include <QMutex>
+#include <QThreadPool>
 
 #include <Eigen/Eigen>
 
@@ -16,6 +18,12 @@
 #include "objectmodel.h"
 #include "debugimageobject.h"
 #include "posefilter.h"
+#include "bloblabeler.h"
+#include "preprocessor.h"
+#include "autothreshold.h"
+#include "distancetransform.h"
+#include "edgeorientations.h"
+#include "poseoptimizer.h"
 
 struct TrackingQuality
 {
@@ -45,11 +53,38 @@ class ObjectEdgesTracker:
                WRITE setAdaptiveBinarizationWinSize NOTIFY adaptiveBinarizationWinSizeChanged)
     Q_PROPERTY(bool useDilate READ useDilate WRITE setUseDilate NOTIFY useDilateChanged)
     Q_PROPERTY(bool useErode READ useErode WRITE setUseErode NOTIFY useErodeChanged)
+    Q_PROPERTY(bool useBlobLabeling READ useBlobLabeling WRITE setUseBlobLabeling
+               NOTIFY useBlobLabelingChanged)
+    Q_PROPERTY(bool useRegionOfInterest READ useRegionOfInterest WRITE setUseRegionOfInterest
+               NOTIFY useRegionOfInterestChanged)
+    Q_PROPERTY(bool usePosePrediction READ usePosePrediction WRITE setUsePosePrediction
+               NOTIFY usePosePredictionChanged)
+    Q_PROPERTY(bool usePipelining READ usePipelining WRITE setUsePipelining NOTIFY usePipeliningChanged)
+    Q_PROPERTY(bool useAutoThreshold READ useAutoThreshold WRITE setUseAutoThreshold
+               NOTIFY useAutoThresholdChanged)
+    Q_PROPERTY(int numberWorkThreads READ numberWorkThreads WRITE setNumberWorkThreads
+               NOTIFY numberWorkThreadsChanged)
 
     Q_PROPERTY(float controlPixelDistance READ controlPixelDistance WRITE setControlPixelDistance
                NOTIFY controlPixelDistanceChanged)
+    Q_PROPERTY(float distanceBandRadius READ distanceBandRadius WRITE setDistanceBandRadius
+               NOTIFY distanceBandRadiusChanged)
+    Q_PROPERTY(int numberOrientationChannels READ numberOrientationChannels WRITE setNumberOrientationChannels
+               NOTIFY numberOrientationChannelsChanged)
+    Q_PROPERTY(bool useCompactDistanceMap READ useCompactDistanceMap WRITE setUseCompactDistanceMap
+               NOTIFY useCompactDistanceMapChanged)
+    Q_PROPERTY(bool useTiledDistanceMap READ useTiledDistanceMap WRITE setUseTiledDistanceMap
+               NOTIFY useTiledDistanceMapChanged)
+    Q_PROPERTY(bool useDistanceGradients READ useDistanceGradients WRITE setUseDistanceGradients
+               NOTIFY useDistanceGradientsChanged)
+    Q_PROPERTY(bool useExactDistanceTransform READ useExactDistanceTransform WRITE setUseExactDistanceTransform
+               NOTIFY useExactDistanceTransformChanged)
+    Q_PROPERTY(bool useModelGuidedFiltering READ useModelGuidedFiltering WRITE setUseModelGuidedFiltering
+               NOTIFY useModelGuidedFilteringChanged)
+    Q_PROPERTY(float modelProximity READ modelProximity WRITE setModelProximity NOTIFY modelProximityChanged)
     Q_PROPERTY(double binaryThreshold READ binaryThreshold WRITE setBinaryThreshold
                NOTIFY binaryThresholdChanged)
+    Q_PROPERTY(double autoBinaryThreshold READ autoBinaryThreshold NOTIFY autoBinaryThresholdChanged)
     Q_PROPERTY(double minBlobArea READ minBlobArea WRITE setMinBlobArea NOTIFY minBlobAreaChanged)
     Q_PROPERTY(double maxBlobCircularity READ maxBlobCircularity WRITE setMaxBlobCircularity
                NOTIFY maxBlobCircularityChanged)
@@ -77,12 +112,71 @@ public:
     bool useErode() const;
     void setUseErode(bool useErode);
 
+    bool useBlobLabeling() const;
+    void setUseBlobLabeling(bool useBlobLabeling);
+
+    bool useRegionOfInterest() const;
+    void setUseRegionOfInterest(bool useRegionOfInterest);
+
+    bool usePosePrediction() const;
+    void setUsePosePrediction(bool usePosePrediction);
+
+    // Prepares the next frame while the previous one is tracked, so after compute() the pose is of the previous frame.
+    bool usePipelining() const;
+    void setUsePipelining(bool usePipelining);
+
+    // Takes the binary threshold of every frame from the histograms of the last frames instead of binaryThreshold,
+    // which is kept for the manual mode. Doesn't change the constant of the adaptive binarization.
+    bool useAutoThreshold() const;
+    void setUseAutoThreshold(bool useAutoThreshold);
+
+    int numberWorkThreads() const;
+    void setNumberWorkThreads(int numberWorkThreads);
+
     float controlPixelDistance() const;
     void setControlPixelDistance(float controlPixelDistance);
 
+    // The radius of the distance map band around the projected model, 0 computes the whole distance map.
+    float distanceBandRadius() const;
+    void setDistanceBandRadius(float distanceBandRadius);
+
+    // The number of the edge orientations with own distance maps, 0 matches the model with all edges.
+    int numberOrientationChannels() const;
+    void setNumberOrientationChannels(int numberOrientationChannels);
+
+    // Stores the distance maps in 8 bits with 1/8 pixel steps, so they take a quarter of the memory.
+    bool useCompactDistanceMap() const;
+    void setUseCompactDistanceMap(bool useCompactDistanceMap);
+
+    // Stores the distance maps in 8x8 tiles, so a bilinear sample with its differences takes one or two tiles.
+    bool useTiledDistanceMap() const;
+    void setUseTiledDistanceMap(bool useTiledDistanceMap);
+
+    // Computes the differences of the distance maps once per frame and packs them with the distances,
+    // the optimizer reads them instead of taking them on every sample. The compact and the tiled
+    // layouts don't apply to these maps.
+    bool useDistanceGradients() const;
+    void setUseDistanceGradients(bool useDistanceGradients);
+
+    // Computes the exact euclidean distances in parallel instead of the chamfer approximation,
+    // in place of the narrow band too.
+    bool useExactDistanceTransform() const;
+    void setUseExactDistanceTransform(bool useExactDistanceTransform);
+
+    // Clears the blobs without pixels near the projected model edges, while the object is tracked.
+    bool useModelGuidedFiltering() const;
+    void setUseModelGuidedFiltering(bool useModelGuidedFiltering);
+
+    // The distance from the projected model edges in pixels, where the blobs are kept by the model-guided filtering.
+    float modelProximity() const;
+    void setModelProximity(float modelProximity);
+
     double binaryThreshold() const;
     void setBinaryThreshold(double binaryThreshold);
 
+    // The last threshold of the automatic mode.
+    double autoBinaryThreshold() const;
+
     double minBlobArea() const;
     void setMinBlobArea(double minBlobArea);
 
@@ -98,15 +192,35 @@ public:
 
     TrackingQuality::Enum trackingQuality() const;
 
-    QMatrix4x4 viewMatrix() const;
+    Pose currentPose() const;
 
-    void compute(cv::Mat image);
+    QMatrix4x4 viewMatrix() const;
+    // The view matrix of the pose predicted for the time, e.g. the presentation time of a rendered frame.
+    QMatrix4x4 viewMatrix(const PoseFilter::TimePoint & time) const;
+
+    // frameIndex is given back by trackedFrameIndex() when the frame is tracked.
+    void compute(cv::Mat image, const PoseFilter::TimePoint & time = PoseFilter::Clock::now(),
+                 int frameIndex = -1);
+    // Tracks the frame which is left in the pipeline.
+    void flush();
+    // The index of the frame of the current pose, or -1 if the last compute() or flush() hasn't tracked a frame.
+    // With the pipelining it is the index of the frame before the one given to compute().
+    int trackedFrameIndex() const;
 
     cv::Mat debugImage() const override;
 
 signals:
     void controlPixelDistanceChanged();
+    void distanceBandRadiusChanged();
+    void numberOrientationChannelsChanged();
+    void useCompactDistanceMapChanged();
+    void useTiledDistanceMapChanged();
+    void useDistanceGradientsChanged();
+    void useExactDistanceTransformChanged();
+    void useModelGuidedFilteringChanged();
+    void modelProximityChanged();
     void binaryThresholdChanged();
+    void autoBinaryThresholdChanged();
     void minBlobAreaChanged();
     void maxBlobCircularityChanged();
     void cameraChanged();
@@ -116,19 +230,64 @@ signals:
     void adaptiveBinarizationWinSizeChanged();
     void useDilateChanged();
     void useErodeChanged();
+    void useBlobLabelingChanged();
+    void useRegionOfInterestChanged();
+    void usePosePredictionChanged();
+    void usePipeliningChanged();
+    void useAutoThresholdChanged();
+    void numberWorkThreadsChanged();
 
 private:
+    // A frame handed over from the preprocessing stage to the pose optimization stage.
+    struct PreparedFrame
+    {
+        int index;
+        PoseFilter::TimePoint time;
+        std::shared_ptr<PinholeCamera> camera;
+        // The part of the frame which is processed and the camera of this part.
+        cv::Rect regionOfInterest;
+        std::shared_ptr<PinholeCamera> regionCamera;
+        cv::Mat edges;
+        // A distance map of every orientation channel or the single map of all edges.
+        std::vector<cv::Mat> distanceMaps;
+        // The outputs of the distance transforms and of the tiling, the distance maps are converted from them
+        // unless they are used as they are.
+        std::vector<cv::Mat> transformedMaps;
+        std::vector<cv::Mat> tiledMaps;
+        // The threshold the frame is binarized with, it is published as autoBinaryThreshold by the caller thread
+        // when it comes from the automatic threshold.
+        double binaryThreshold;
+        bool autoThreshold;
+    };
+
     bool m_useLaplacian;
     bool m_useAdaptiveBinarization;
     int m_adaptiveBinarizationWinSize;
     bool m_useDilate;
     bool m_useErode;
+    bool m_useBlobLabeling;
+    bool m_useRegionOfInterest;
+    bool m_usePosePrediction;
+    bool m_usePipelining;
+    bool m_useAutoThreshold;
+    int m_numberWorkThreads;
 
     QSharedPointer<PerformanceMonitor> m_monitor;
+    // Guards the pose filter, the debug image and the automatic threshold, they are read from other threads.
+    mutable QMutex m_poseMutex;
     PoseFilter m_poseFilter;
 
     float m_controlPixelDistance;
+    float m_distanceBandRadius;
+    int m_numberOrientationChannels;
+    bool m_useCompactDistanceMap;
+    bool m_useTiledDistanceMap;
+    bool m_useDistanceGradients;
+    bool m_useExactDistanceTransform;
+    bool m_useModelGuidedFiltering;
+    float m_modelProximity;
     double m_binaryThreshold;
+    double m_autoBinaryThreshold;
     double m_minBlobArea;
     double m_maxBlobCircularity;
 
@@ -138,14 +297,76 @@ private:
     Pose m_resetCameraPose;
 
     TrackingQuality::Enum m_trackingQuality;
+    PoseFilter::TimePoint m_frameTime;
+    int m_trackedFrameIndex;
+
+    Preprocessor m_preprocessor;
+    BlobLabeler m_blobLabeler;
+    AutoThreshold m_autoThreshold;
+    std::vector<int> m_histogram;
+    std::vector<cv::Mat> m_orientationChannels;
+
+    // The buffers of the stages, they keep their memory from frame to frame.
+    // The preprocessing stage uses only its own buffers, so it can run alongside the tracking.
+    cv::Mat m_binImage;
+    // The coarse mask of the cells near the projected model edges and the flags of the blobs and holes in it.
+    cv::Mat m_modelMask;
+    std::vector<uchar> m_modelBlobs;
+    std::vector<uchar> m_modelHoles;
+    std::vector<uchar> m_keepBlobs;
+    std::vector<uchar> m_keepHoles;
+    Vectors3f m_stageControlPoints;
+    Vectors2f m_bandPoints;
+    std::vector<std::vector<cv::Point>> m_contours;
+    EdgeOrientationBuffers m_edgeOrientationBuffers;
+    // The buffers of the distance transform of every orientation channel, the channels are transformed in parallel.
+    std::vector<DistanceTransformBuffers> m_distanceTransformBuffers;
+    // The buffers of the tracking stage.
+    Vectors3f m_controlModelPoints;
+    Vectors2f m_imageDirections;
+    std::vector<int> m_distanceMapIndices;
+    PoseOptimizerBuffers m_poseOptimizerBuffers;
+    std::vector<std::string> m_tracking1Timers;
+    std::vector<std::string> m_tracking2Timers;
+    cv::Mat m_trackingDistances;
+    cv::Mat m_trackingLabels;
+    cv::Mat m_nearestEdges;
+    DistanceTransformBuffers m_trackingDistanceBuffers;
+    // The edge point of every label of the distance transform with the labels of the pixels.
+    std::vector<Eigen::Vector2i> m_labelPoints;
+
+    // The single thread of the preprocessing stage, its work is split further on the global pool.
+    QThreadPool m_stageThreadPool;
+    // The prepared frames are reused with their buffers, a frame is free when only the pool holds it.
+    std::vector<std::shared_ptr<PreparedFrame>> m_framePool;
+    std::shared_ptr<PreparedFrame> m_pendingFrame;
 
     cv::Mat m_debugImage;
 
+    static QMatrix4x4 _pose2viewMatrix(const Pose & pose);
     Eigen::Matrix<double, 6, 1> _pose2x(const Pose & pose) const;
     Pose _x2pose(const Eigen::Matrix<double, 6, 1> & x) const;
 
-    float _tracking1(const cv::Mat & edges);
-    float _tracking2(const cv::Mat & edges);
+    cv::Rect _computeRegionOfInterest(const PreparedFrame & frame, const PoseFilter & poseFilter,
+                                      TrackingQuality::Enum trackingQuality) const;
+    void _setRegionOfInterest(PreparedFrame & frame, const cv::Rect & regionOfInterest) const;
+
+    std::shared_ptr<PreparedFrame> _acquireFrame();
+
+    // The stages of a frame, the preprocessing uses the pose filter and the quality given by the caller,
+    // so it can run while the previous frame is tracked.
+    void _prepareFrame(PreparedFrame & frame, cv::Mat image, const PoseFilter & poseFilter,
+                       TrackingQuality::Enum trackingQuality, double binaryThreshold);
+    void _applyAutoThreshold(const PreparedFrame & frame);
+    void _trackFrame(const PreparedFrame & frame);
+
+    bool _computeModelMask(const PreparedFrame & frame, const PoseFilter & poseFilter,
+                           TrackingQuality::Enum trackingQuality);
+    void _selectBlobs(const cv::Mat & binImage, bool useModelMask);
+    void _filterContours(cv::Mat & binImage, bool useModelMask);
+
+    float _tracking1(const PreparedFrame & frame);
+    float _tracking2(const PreparedFrame & frame);
 
     TrackingQuality::Enum _error2quality(float error) const;
     void _setTrackingQuality(TrackingQuality::Enum quality);
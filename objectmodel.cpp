@@ -5,6 +5,7 @@
 #include <limits>
 #include <set>
 #include <utility>
+#include <algorithm>
 
 #include <opencv2/imgproc.hpp>
 
@@ -70,6 +71,7 @@ ObjectModel ObjectModel::createBox(const Vector3f & size)
         assert(fabs(dd) < std::numeric_limits<double>::epsilon());
     }*/
 
+    box._updateEdges();
     return box;
 }
 
@@ -137,6 +139,7 @@ ObjectModel ObjectModel::createCubikRubik(float border)
         assert(fabs(dd) < std::numeric_limits<double>::epsilon());
     }*/
 
+    model._updateEdges();
     return model;
 }
 
@@ -215,6 +218,7 @@ ObjectModel ObjectModel::createHouse()
         assert(fabs(dd) < std::numeric_limits<float>::epsilon());
     }
 
+    model._updateEdges();
     return model;
 }
 
@@ -233,6 +237,7 @@ ObjectModel ObjectModel::mirroredX(const ObjectModel & model)
             vertexIndices[i] = polygon.vertexIndices[polygon.vertexIndices.size() - 1 - i];
         polygon.vertexIndices = move(vertexIndices);
     }
+    r._updateEdges();
     return r;
 }
 
@@ -251,6 +256,7 @@ ObjectModel & ObjectModel::merge(const ObjectModel & model)
     m_polygons.insert(m_polygons.end(), new_polygons.cbegin(), new_polygons.cend());
     for (const pair<int, int> & i_d_edge : model.m_disabledEdges)
         m_disabledEdges.insert(make_pair(i_d_edge.first + offset_v, i_d_edge.second + offset_v));
+    _updateEdges();
     return (*this);
 }
 
@@ -264,46 +270,46 @@ const ObjectModel::Polygons & ObjectModel::polygons() const
     return m_polygons;
 }
 
-Vectors3f ObjectModel::getControlPoints(const std::shared_ptr<PinholeCamera> & camera,
-                                        float controlPixelDistance,
-                                        const Matrix3f & R, const Vector3f & t) const
+void ObjectModel::getControlPoints(const std::shared_ptr<PinholeCamera> & camera,
+                                   float controlPixelDistance,
+                                   const Matrix3f & R, const Vector3f & t,
+                                   Vectors3f & controlModelPoints,
+                                   Vectors2f * imageDirections) const
 {
-    std::set<int> setOfVertices;
-    std::set<std::pair<int, int>, less_pair_i> setOfEdges;
     Vector3f cam_pose = - R.inverse() * t;
-    for (const Polygon & polygon : m_polygons)
+
+    // A small step along the edge from a point in the view stays in front of the camera.
+    auto imageDirection = [&] (const Vector3f & point, const Vector2f & imagePoint,
+                               const std::pair<int, int> & edge) -> Vector2f
     {
-        if (polygon.normal.dot(cam_pose - m_vertices[polygon.vertexIndices[0]]) > 0.0f)
-        {
-            for (int i = 0; i < polygon.vertexIndices.size(); ++i)
-            {
-                std::pair<int, int> edge(polygon.vertexIndices[i],
-                                         polygon.vertexIndices[(i + 1) % polygon.vertexIndices.size()]);
-                if (edge.first > edge.second)
-                    std::swap(edge.first, edge.second);
-                if (m_disabledEdges.find(edge) != m_disabledEdges.cend())
-                    continue;
-                setOfEdges.insert(edge);
-                setOfVertices.insert(polygon.vertexIndices[i]);
-            }
-        }
-    }
+        Vector3f step = (m_vertices[edge.second] - m_vertices[edge.first]) * 1e-2f;
+        return camera->project((R * (point + step) + t).eval()) - imagePoint;
+    };
 
-    Vectors3f controlModelPoints;
-    for (auto it = setOfVertices.cbegin(); it != setOfVertices.cend(); ++it)
+    controlModelPoints.clear();
+    if (imageDirections)
+        imageDirections->clear();
+    for (int vertexIndex = 0; vertexIndex < static_cast<int>(m_vertices.size()); ++vertexIndex)
     {
-        const Vector3f & vertex = m_vertices[*it];
+        const VertexEdge * vertexEdge = _visibleVertexEdge(vertexIndex, cam_pose);
+        if (!vertexEdge)
+            continue;
+        const Vector3f & vertex = m_vertices[static_cast<size_t>(vertexIndex)];
         bool inViewFlag;
         Vector2f p = camera->project((R * vertex + t).eval(), inViewFlag);
-        (void)(p);
         if (!inViewFlag)
             continue;
         controlModelPoints.push_back(vertex);
+        if (imageDirections)
+            imageDirections->push_back(imageDirection(vertex, p, m_edges[static_cast<size_t>(vertexEdge->edge)]));
     }
-    for (auto itEdge = setOfEdges.cbegin(); itEdge != setOfEdges.cend(); ++itEdge)
+    for (int edgeIndex = 0; edgeIndex < static_cast<int>(m_edges.size()); ++edgeIndex)
     {
-        const Vector3f & vertex1 = m_vertices[itEdge->first];
-        const Vector3f & vertex2 = m_vertices[itEdge->second];
+        if (!_isEdgeVisible(edgeIndex, cam_pose))
+            continue;
+        const std::pair<int, int> & edge = m_edges[static_cast<size_t>(edgeIndex)];
+        const Vector3f & vertex1 = m_vertices[edge.first];
+        const Vector3f & vertex2 = m_vertices[edge.second];
 
         Vector3f v1 = (R * vertex1 + t);
         if (v1.z() < numeric_limits<float>::epsilon())
@@ -328,13 +334,13 @@ Vectors3f ObjectModel::getControlPoints(const std::shared_ptr<PinholeCamera> & c
             Vector3f v = vertex1 + delta * k;
             bool inViewFlag;
             Vector2f p = camera->project((R * v + t).eval(), inViewFlag);
-            (void)(p);
             if (!inViewFlag)
                 continue;
             controlModelPoints.push_back(v);
+            if (imageDirections)
+                imageDirections->push_back(imageDirection(v, p, edge));
         }
     }
-    return controlModelPoints;
 }
 
 tuple<Vectors3f, Vectors2f> ObjectModel::getControlAndImagePoints(const shared_ptr<PinholeCamera> & camera,
@@ -458,3 +464,101 @@ void ObjectModel::draw(const cv::Mat & image,
     }
 }
 
+
+void ObjectModel::_updateEdges()
+{
+    auto polygonEdge = [] (const Polygon & polygon, int i) -> std::pair<int, int>
+    {
+        std::pair<int, int> edge(polygon.vertexIndices[i],
+                                 polygon.vertexIndices[(i + 1) % polygon.vertexIndices.size()]);
+        if (edge.first > edge.second)
+            std::swap(edge.first, edge.second);
+        return edge;
+    };
+
+    m_edges.clear();
+    for (const Polygon & polygon : m_polygons)
+    {
+        for (int i = 0; i < polygon.vertexIndices.size(); ++i)
+        {
+            std::pair<int, int> edge = polygonEdge(polygon, i);
+            if (m_disabledEdges.find(edge) == m_disabledEdges.cend())
+                m_edges.push_back(edge);
+        }
+    }
+    sort(m_edges.begin(), m_edges.end(), less_pair_i());
+    m_edges.erase(unique(m_edges.begin(), m_edges.end()), m_edges.end());
+
+    vector<vector<int>> edgePolygons(m_edges.size());
+    vector<vector<VertexEdge>> vertexEdges(m_vertices.size());
+    for (int polygonIndex = 0; polygonIndex < static_cast<int>(m_polygons.size()); ++polygonIndex)
+    {
+        const Polygon & polygon = m_polygons[static_cast<size_t>(polygonIndex)];
+        for (int i = 0; i < polygon.vertexIndices.size(); ++i)
+        {
+            std::pair<int, int> edge = polygonEdge(polygon, i);
+            auto it = lower_bound(m_edges.cbegin(), m_edges.cend(), edge, less_pair_i());
+            if ((it == m_edges.cend()) || (*it != edge))
+                continue;
+            int edgeIndex = static_cast<int>(it - m_edges.cbegin());
+            vector<int> & polygons = edgePolygons[static_cast<size_t>(edgeIndex)];
+            if (polygons.empty() || (polygons.back() != polygonIndex))
+                polygons.push_back(polygonIndex);
+            int start = polygon.vertexIndices[i];
+            vertexEdges[static_cast<size_t>(edge.first)].push_back({ polygonIndex, edgeIndex, start == edge.first });
+            vertexEdges[static_cast<size_t>(edge.second)].push_back({ polygonIndex, edgeIndex, start == edge.second });
+        }
+    }
+
+    m_edgePolygonOffsets.assign(1, 0);
+    m_edgePolygons.clear();
+    for (const vector<int> & polygons : edgePolygons)
+    {
+        m_edgePolygons.insert(m_edgePolygons.end(), polygons.cbegin(), polygons.cend());
+        m_edgePolygonOffsets.push_back(static_cast<int>(m_edgePolygons.size()));
+    }
+    m_vertexEdgeOffsets.assign(1, 0);
+    m_vertexEdges.clear();
+    for (const vector<VertexEdge> & edges : vertexEdges)
+    {
+        m_vertexEdges.insert(m_vertexEdges.end(), edges.cbegin(), edges.cend());
+        m_vertexEdgeOffsets.push_back(static_cast<int>(m_vertexEdges.size()));
+    }
+}
+
+bool ObjectModel::_isPolygonVisible(int polygonIndex, const Vector3f & cameraPosition) const
+{
+    const Polygon & polygon = m_polygons[static_cast<size_t>(polygonIndex)];
+    return polygon.normal.dot(cameraPosition - m_vertices[polygon.vertexIndices[0]]) > 0.0f;
+}
+
+bool ObjectModel::_isEdgeVisible(int edgeIndex, const Vector3f & cameraPosition) const
+{
+    for (int i = m_edgePolygonOffsets[static_cast<size_t>(edgeIndex)];
+         i < m_edgePolygonOffsets[static_cast<size_t>(edgeIndex) + 1]; ++i)
+    {
+        if (_isPolygonVisible(m_edgePolygons[static_cast<size_t>(i)], cameraPosition))
+            return true;
+    }
+    return false;
+}
+
+const ObjectModel::VertexEdge * ObjectModel::_visibleVertexEdge(int vertexIndex,
+                                                                const Vector3f & cameraPosition) const
+{
+    // A vertex is taken as the start of an edge of a visible polygon, it gets the direction of its first edge
+    // in a visible polygon, which can come before this one.
+    const VertexEdge * firstEdge = nullptr;
+    for (int i = m_vertexEdgeOffsets[static_cast<size_t>(vertexIndex)];
+         i < m_vertexEdgeOffsets[static_cast<size_t>(vertexIndex) + 1]; ++i)
+    {
+        const VertexEdge & vertexEdge = m_vertexEdges[static_cast<size_t>(i)];
+        if (!_isPolygonVisible(vertexEdge.polygon, cameraPosition))
+            continue;
+        if (!firstEdge)
+            firstEdge = &vertexEdge;
+        if (vertexEdge.starts)
+            return firstEdge;
+    }
+    return nullptr;
+}
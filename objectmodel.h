@@ -50,10 +50,15 @@ public:
     const Vectors3f & vertices() const;
     const Polygons & polygons() const;
 
-    Vectors3f getControlPoints(const std::shared_ptr<PinholeCamera> & camera,
-                               float controlPixelDistance,
-                               const Eigen::Matrix3f & R,
-                               const Eigen::Vector3f & t) const;
+    // The image directions are the directions of the projected model edges through the control points,
+    // a vertex takes the direction of one of its edges. The points are written into controlModelPoints,
+    // so a caller which keeps the vector doesn't allocate it for every pose.
+    void getControlPoints(const std::shared_ptr<PinholeCamera> & camera,
+                          float controlPixelDistance,
+                          const Eigen::Matrix3f & R,
+                          const Eigen::Vector3f & t,
+                          Vectors3f & controlModelPoints,
+                          Vectors2f * imageDirections = nullptr) const;
 
     std::tuple<Vectors3f, Vectors2f> getControlAndImagePoints(const std::shared_ptr<PinholeCamera> & camera,
                                                               float controlPixelDistance,
@@ -64,12 +69,36 @@ public:
               const Eigen::Matrix3f & R, const Eigen::Vector3f & t) const;
 
 private:
+    // An edge which ends at a vertex, seen from the vertex.
+    struct VertexEdge
+    {
+        int polygon;
+        int edge;
+        // The edge starts at the vertex in the order of the vertices of the polygon.
+        bool starts;
+    };
+
     ObjectModel();
 
     Vectors3f m_vertices;
     Polygons m_polygons;
 
     std::set<std::pair<int, int>> m_disabledEdges;
+
+    // The enabled edges in order without repeats with the polygons of every edge, and the edges of every vertex
+    // in the order of the polygons, so the visible edges of a pose are found without building sets.
+    std::vector<std::pair<int, int>> m_edges;
+    std::vector<int> m_edgePolygonOffsets;
+    std::vector<int> m_edgePolygons;
+    std::vector<int> m_vertexEdgeOffsets;
+    std::vector<VertexEdge> m_vertexEdges;
+
+    void _updateEdges();
+
+    bool _isPolygonVisible(int polygonIndex, const Eigen::Vector3f & cameraPosition) const;
+    bool _isEdgeVisible(int edgeIndex, const Eigen::Vector3f & cameraPosition) const;
+    // The first edge of the vertex in a visible polygon or nullptr if the vertex doesn't start a visible edge.
+    const VertexEdge * _visibleVertexEdge(int vertexIndex, const Eigen::Vector3f & cameraPosition) const;
 };
 
 #endif // OBJECTMODEL_H
@@ -46,6 +46,9 @@ windows {
             LIBS += -L$$(OPENCV_LIB_PATH) -lopencv_java4
         }
     }
+} else: unix {
+    CONFIG += link_pkgconfig
+    PKGCONFIG += opencv4
 } else {
     error("OpenCV not included")
 }
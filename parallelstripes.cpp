@@ -0,0 +1,43 @@
+#include "parallelstripes.h"
+
+#include <algorithm>
+
+#include <QSemaphore>
+#include <QtConcurrent/QtConcurrent>
+
+using namespace std;
+
+size_t parallelStripes(QThreadPool * pool, size_t numberStripes, int rows, int minStripeRows,
+                       const StripeFunction & function)
+{
+    if (rows <= 0)
+        return 0;
+    size_t maxNumberStripes = static_cast<size_t>(max(rows / max(minStripeRows, 1), 1));
+    numberStripes = max(min(numberStripes, maxNumberStripes), static_cast<size_t>(1));
+
+    auto runStripe = [&] (size_t i)
+    {
+        int beginRow = static_cast<int>((static_cast<size_t>(rows) * i) / numberStripes);
+        int endRow = static_cast<int>((static_cast<size_t>(rows) * (i + 1)) / numberStripes);
+        function(i, beginRow, endRow);
+    };
+
+    if (numberStripes == 1)
+    {
+        runStripe(0);
+        return 1;
+    }
+
+    // The calling thread would wait anyway, so it takes the last stripe.
+    QSemaphore semaphore;
+    for (size_t i = 0; i + 1 < numberStripes; ++i)
+    {
+        QtConcurrent::run(pool, [&, i] () {
+            runStripe(i);
+            semaphore.release();
+        });
+    }
+    runStripe(numberStripes - 1);
+    semaphore.acquire(static_cast<int>(numberStripes - 1));
+    return numberStripes;
+}
@@ -0,0 +1,26 @@
+#ifndef PARALLELSTRIPES_H
+#define PARALLELSTRIPES_H
+
+#include <cstddef>
+#include <functional>
+
+#include <QThreadPool>
+
+using StripeFunction = std::function<void(size_t stripeIndex, int beginRow, int endRow)>;
+
+// Splits the rows into the stripes of nearly equal height and runs the function for every stripe,
+// all but the last one on the pool. The stripes are not lower than minStripeRows, if there are enough rows.
+// Returns the number of the stripes.
+size_t parallelStripes(QThreadPool * pool, size_t numberStripes, int rows, int minStripeRows,
+                       const StripeFunction & function);
+
+// Takes the function by a reference, so a lambda with many captures isn't copied to the heap
+// by StripeFunction on every call.
+template <typename Function>
+size_t parallelStripes(QThreadPool * pool, size_t numberStripes, int rows, int minStripeRows,
+                       const Function & function)
+{
+    return parallelStripes(pool, numberStripes, rows, minStripeRows, StripeFunction(std::cref(function)));
+}
+
+#endif // PARALLELSTRIPES_H
@@ -14,29 +14,41 @@ PerformanceMonitor::PerformanceMonitor()
     m_countUsedTimes = 10;
     m_currentCommonTime.first = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
     m_currentCommonTime.second = m_currentCommonTime.first;
+    m_preciseStart = steady_clock::now();
+    m_lastCommonTime = microseconds(0);
 }
 
 size_t PerformanceMonitor::countUsedTimes() const
 {
+    lock_guard<mutex> locker(m_mutex);
     return m_countUsedTimes;
 }
 
 void PerformanceMonitor::setCountUsedTimes(const size_t & countUsedTimes)
 {
+    lock_guard<mutex> locker(m_mutex);
     m_countUsedTimes = countUsedTimes;
 }
 
 size_t PerformanceMonitor::countTimers() const
 {
+    lock_guard<mutex> locker(m_mutex);
     return m_timers.size();
 }
 
 PerformanceMonitor::Timer PerformanceMonitor::timer(size_t index) const
 {
+    lock_guard<mutex> locker(m_mutex);
     return m_timers[index];
 }
 
 milliseconds PerformanceMonitor::commonTime() const
+{
+    lock_guard<mutex> locker(m_mutex);
+    return _commonTime();
+}
+
+milliseconds PerformanceMonitor::_commonTime() const
 {
     if (m_commonTimes.empty())
         return m_currentCommonTime.second - m_currentCommonTime.first;
@@ -44,7 +56,32 @@ milliseconds PerformanceMonitor::commonTime() const
                       m_commonTimes.size();
 }
 
+microseconds PerformanceMonitor::lastCommonTime() const
+{
+    lock_guard<mutex> locker(m_mutex);
+    return m_lastCommonTime;
+}
+
+vector<pair<string, microseconds>> PerformanceMonitor::lastDurations() const
+{
+    lock_guard<mutex> locker(m_mutex);
+    return m_lastDurations;
+}
+
 void PerformanceMonitor::startTimer(const string & name)
+{
+    lock_guard<mutex> locker(m_mutex);
+    _startTimer(name);
+}
+
+void PerformanceMonitor::startTimer(const char * name)
+{
+    lock_guard<mutex> locker(m_mutex);
+    m_timerName.assign(name);
+    _startTimer(m_timerName);
+}
+
+void PerformanceMonitor::_startTimer(const string & name)
 {
     auto it = m_running_timers.find(name);
     if (it == m_running_timers.end())
@@ -53,17 +90,33 @@ void PerformanceMonitor::startTimer(const string & name)
                                     name,
                                     { vector<milliseconds>(),
                                       duration_cast<milliseconds>(system_clock::now().time_since_epoch()),
-                                      m_currentIndex }));
+                                      m_currentIndex,
+                                      steady_clock::now(),
+                                      microseconds(0) }));
     }
     else
     {
         it->second.last_start = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
         it->second.currentIndex = m_currentIndex;
+        it->second.last_precise_start = steady_clock::now();
     }
     ++m_currentIndex;
 }
 
 void PerformanceMonitor::endTimer(const string & name)
+{
+    lock_guard<mutex> locker(m_mutex);
+    _endTimer(name);
+}
+
+void PerformanceMonitor::endTimer(const char * name)
+{
+    lock_guard<mutex> locker(m_mutex);
+    m_timerName.assign(name);
+    _endTimer(m_timerName);
+}
+
+void PerformanceMonitor::_endTimer(const string & name)
 {
     auto it = m_running_timers.find(name);
     if (it != m_running_timers.end())
@@ -76,6 +129,8 @@ void PerformanceMonitor::endTimer(const string & name)
         }
         it->second.durations.push_back(duration_cast<milliseconds>(system_clock::now().time_since_epoch()) -
                                        it->second.last_start);
+        it->second.last_duration = duration_cast<microseconds>(steady_clock::now() -
+                                                               it->second.last_precise_start);
     }
     else
     {
@@ -85,6 +140,7 @@ void PerformanceMonitor::endTimer(const string & name)
 
 void PerformanceMonitor::start()
 {
+    lock_guard<mutex> locker(m_mutex);
     m_currentIndex = 0;
     m_timers.resize(0);
     for (auto it = m_running_timers.begin(); it != m_running_timers.end(); ++it)
@@ -93,11 +149,14 @@ void PerformanceMonitor::start()
     }
     m_currentCommonTime.first = duration_cast<milliseconds>(
                 system_clock::now().time_since_epoch());
+    m_preciseStart = steady_clock::now();
 }
 
 void PerformanceMonitor::end()
 {
+    lock_guard<mutex> locker(m_mutex);
     m_currentCommonTime.second = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+    m_lastCommonTime = duration_cast<microseconds>(steady_clock::now() - m_preciseStart);
     if (m_commonTimes.size() >= m_countUsedTimes)
     {
         m_commonTimes.erase(m_commonTimes.begin(),
@@ -124,15 +183,18 @@ void PerformanceMonitor::end()
         return (a.second < b.second);
     });
     m_timers.resize(timers.size());
+    m_lastDurations.resize(timers.size());
     for (size_t i = 0; i < timers.size(); ++i)
     {
         m_timers[i] = timers[indices[i].first];
+        m_lastDurations[i] = { m_timers[i].name, m_running_timers[m_timers[i].name].last_duration };
     }
 }
 
 string PerformanceMonitor::report() const
 {
-    string str = "Common time: " + to_string(commonTime().count()) + "\n";
+    lock_guard<mutex> locker(m_mutex);
+    string str = "Common time: " + to_string(_commonTime().count()) + "\n";
     for (const Timer & timer : m_timers)
         str += "    " + timer.name + " : " + to_string(timer.duration) + "\n";
     return str;
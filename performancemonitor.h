@@ -8,7 +8,9 @@
 #include <chrono>
 #include <algorithm>
 #include <numeric>
+#include <mutex>
 
+// The timers can be started and ended from several threads, e.g. by the stages of the tracker pipeline.
 class PerformanceMonitor
 {
 public:
@@ -28,8 +30,16 @@ public:
 
     std::chrono::milliseconds commonTime() const;
 
+    // Precise durations of the last frame, between start() and end(), in the order of starting.
+    std::chrono::microseconds lastCommonTime() const;
+    std::vector<std::pair<std::string, std::chrono::microseconds>> lastDurations() const;
+
     void startTimer(const std::string & name);
     void endTimer(const std::string & name);
+    // The names given by literals are copied into a kept buffer instead of a temporary string,
+    // so the timers of a frame don't allocate.
+    void startTimer(const char * name);
+    void endTimer(const char * name);
 
     void start();
     void end();
@@ -42,6 +52,8 @@ private:
         std::vector<std::chrono::milliseconds> durations;
         std::chrono::milliseconds last_start;
         std::size_t currentIndex;
+        std::chrono::steady_clock::time_point last_precise_start;
+        std::chrono::microseconds last_duration;
 
         std::chrono::milliseconds getAvgDuration() const
         {
@@ -52,12 +64,21 @@ private:
         }
     };
 
+    mutable std::mutex m_mutex;
     std::map<std::string, TimerInfo> m_running_timers;
     std::size_t m_currentIndex;
     std::vector<Timer> m_timers;
     std::vector<std::chrono::milliseconds> m_commonTimes;
     std::pair<std::chrono::milliseconds, std::chrono::milliseconds> m_currentCommonTime;
+    std::chrono::steady_clock::time_point m_preciseStart;
+    std::chrono::microseconds m_lastCommonTime;
+    std::vector<std::pair<std::string, std::chrono::microseconds>> m_lastDurations;
     std::size_t m_countUsedTimes;
+    std::string m_timerName;
+
+    std::chrono::milliseconds _commonTime() const;
+    void _startTimer(const std::string & name);
+    void _endTimer(const std::string & name);
 };
 
 #endif // PERFORMANCEMONITOR_H
@@ -13,6 +13,18 @@ PinholeCamera::PinholeCamera(const Vector2i & imageSize,
 {
 }
 
+std::shared_ptr<PinholeCamera> PinholeCamera::createFromRelative(const Vector2i & imageSize,
+                                                               const QVector2D & focalLength,
+                                                               const QVector2D & opticalCenter,
+                                                               const QVector2D & viewScale)
+{
+    Vector2f pixelFocalLength(imageSize.x() * focalLength.x() * viewScale.x(),
+                              - imageSize.x() * focalLength.y() * viewScale.x());
+    Vector2f pixelOpticalCenter(imageSize.x() * ((opticalCenter.x() - 0.5f) * viewScale.x() + 0.5f),
+                                imageSize.y() * ((opticalCenter.y() - 0.5f) * viewScale.y() + 0.5f));
+    return std::make_shared<PinholeCamera>(imageSize, pixelFocalLength, pixelOpticalCenter);
+}
+
 Vector2i PinholeCamera::imageSize() const
 {
     return m_imageSize;
@@ -1,6 +1,8 @@
 #ifndef PINHOLECAMERA_H
 #define PINHOLECAMERA_H
 
+#include <memory>
+
 #include <QVector2D>
 
 #include <Eigen/Eigen>
@@ -12,6 +14,13 @@ public:
                   const Eigen::Vector2f & pixelFocalLength = { 640.0f, 640.0f },
                   const Eigen::Vector2f & pixelOpticalCenter = { 320.0f, 240.0f });
 
+    // Creates a camera from the focal length and the optical center relative to the image width and height.
+    // The view scale is the part of the frame that is covered by the image.
+    static std::shared_ptr<PinholeCamera> createFromRelative(const Eigen::Vector2i & imageSize,
+                                                             const QVector2D & focalLength,
+                                                             const QVector2D & opticalCenter,
+                                                             const QVector2D & viewScale = QVector2D(1.0f, 1.0f));
+
     Eigen::Vector2i imageSize() const;
     Eigen::Vector2f pixelFocalLength() const;
     Eigen::Vector2f pixelOpticalCenter() const;
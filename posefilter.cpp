@@ -1,5 +1,9 @@
 #include "posefilter.h"
 
+#include <algorithm>
+
+using namespace std;
+using namespace std::chrono;
 using namespace Eigen;
 
 PoseFilter::Motion::Motion()
@@ -48,6 +52,12 @@ PoseFilter::Pose PoseFilter::Pose::getNext(const PoseFilter::Motion & motion) co
     return Pose(position + motion.linear, motion.angular * rotation);
 }
 
+PoseFilter::Pose PoseFilter::Pose::getNext(const PoseFilter::Motion & motion, double k) const
+{
+    AngleAxisd angular(motion.angular);
+    return Pose(position + motion.linear * k, AngleAxisd(angular.angle() * k, angular.axis()) * rotation);
+}
+
 PoseFilter::Pose PoseFilter::Pose::mix(const PoseFilter::Pose & pose, double k_position, double k_angular) const
 {
     return Pose(position * (1.0 - k_position) + pose.position * k_position,
@@ -56,7 +66,8 @@ PoseFilter::Pose PoseFilter::Pose::mix(const PoseFilter::Pose & pose, double k_p
 
 PoseFilter::PoseFilter():
     m_positionWeights(100.0, 1.0),
-    m_rotationWeights(100.0, 1.0)
+    m_rotationWeights(100.0, 1.0),
+    m_maxPredictionSteps(2.0)
 {
     reset();
 }
@@ -81,18 +92,32 @@ void PoseFilter::setRotationWeights(const Vector2d & rotationWeights)
     m_rotationWeights = rotationWeights;
 }
 
+double PoseFilter::maxPredictionSteps() const
+{
+    return m_maxPredictionSteps;
+}
+
+void PoseFilter::setMaxPredictionSteps(double maxPredictionSteps)
+{
+    m_maxPredictionSteps = maxPredictionSteps;
+}
+
 void PoseFilter::reset()
 {
     m_currentStep = 0;
     m_pose.reset();
     m_motion.reset();
+    m_time = Clock::now();
+    m_stepDuration = 0.0;
 }
 
-void PoseFilter::reset(const Pose & pose)
+void PoseFilter::reset(const Pose & pose, const TimePoint & time)
 {
     m_currentStep = 1;
     m_pose = pose;
     m_motion.reset();
+    m_time = time;
+    m_stepDuration = 0.0;
 }
 
 const PoseFilter::Pose & PoseFilter::currentPose() const
@@ -105,8 +130,13 @@ const PoseFilter::Motion & PoseFilter::currentMotion() const
     return m_motion;
 }
 
-const PoseFilter::Pose & PoseFilter::next(const PoseFilter::Pose & rawPose)
+const PoseFilter::Pose & PoseFilter::next(const PoseFilter::Pose & rawPose, const TimePoint & time)
 {
+    double stepDuration = duration_cast<duration<double>>(time - m_time).count();
+    if ((m_currentStep > 0) && (stepDuration > 0.0))
+        m_stepDuration = (m_stepDuration > 0.0) ? (m_stepDuration * 0.75 + stepDuration * 0.25) : stepDuration;
+    m_time = time;
+
     if (m_currentStep == 0)
     {
         m_pose = rawPose;
@@ -130,6 +160,20 @@ const PoseFilter::Pose & PoseFilter::next(const PoseFilter::Pose & rawPose)
     return m_pose;
 }
 
+PoseFilter::TimePoint PoseFilter::currentTime() const
+{
+    return m_time;
+}
+
+PoseFilter::Pose PoseFilter::predictedPose(const TimePoint & time) const
+{
+    if ((m_currentStep < 2) || (m_stepDuration <= 0.0))
+        return m_pose;
+    double k = duration_cast<duration<double>>(time - m_time).count() / m_stepDuration;
+    k = min(max(k, 0.0), m_maxPredictionSteps);
+    return m_pose.getNext(m_motion, k);
+}
+
 int PoseFilter::currentStep() const
 {
     return m_currentStep;
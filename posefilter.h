@@ -1,11 +1,16 @@
 #ifndef POSEFILTER_H
 #define POSEFILTER_H
 
+#include <chrono>
+
 #include <Eigen/Eigen>
 
 class PoseFilter
 {
 public:
+    using Clock = std::chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+
     struct Motion
     {
         Eigen::Vector3d linear;
@@ -30,6 +35,7 @@ public:
 
         Motion getMotion(const Pose & next) const;
         Pose getNext(const Motion & motion) const;
+        Pose getNext(const Motion & motion, double k) const;
 
         Pose mix(const Pose & pose, double k_position, double k_angular) const;
     };
@@ -42,12 +48,20 @@ public:
     Eigen::Vector2d rotationWeights() const;
     void setRotationWeights(const Eigen::Vector2d & rotationWeights);
 
+    // Limits the extrapolation of predictedPose(), in steps of the filter.
+    double maxPredictionSteps() const;
+    void setMaxPredictionSteps(double maxPredictionSteps);
+
     void reset();
-    void reset(const Pose & pose);
+    void reset(const Pose & pose, const TimePoint & time = Clock::now());
 
     const Pose & currentPose() const;
     const Motion & currentMotion() const;
-    const Pose & next(const Pose & rawPose);
+    const Pose & next(const Pose & rawPose, const TimePoint & time = Clock::now());
+
+    TimePoint currentTime() const;
+    // Extrapolates the current pose to the time with the current motion.
+    Pose predictedPose(const TimePoint & time) const;
 
     int currentStep() const;
 
@@ -55,9 +69,13 @@ private:
     Eigen::Vector2d m_positionWeights;
     Eigen::Vector2d m_rotationWeights;
 
+    double m_maxPredictionSteps;
+
     Pose m_pose;
     Motion m_motion;
     int m_currentStep;
+    TimePoint m_time;
+    double m_stepDuration;
 };
 
 #endif // POSEFILTER_H
@@ -1,8 +1,10 @@
 #include "poseoptimizer.h"
 
+#include <cassert>
 #include <cmath>
 #include <qmath.h>
 #include <tuple>
+#include <type_traits>
 #include <climits>
 #include <limits>
 
@@ -10,6 +12,7 @@
 #include <QtConcurrent/QtConcurrent>
 
 #include "pinholecamera.h"
+#include "tiledimage.h"
 
 using namespace std;
 using namespace Eigen;
@@ -304,6 +307,104 @@ Matrix3d exp_jacobian(const Vector3d & w,
               (R.transpose() - Matrix3d::Identity()) * skewMatrix(w)) / l);
 }
 
+namespace {
+
+template <typename Type, bool tiled>
+inline float distanceAt(const cv::Mat & distanceMap, int x, int y)
+{
+    return tiled ? tiledPixel<Type>(distanceMap, x, y) : distanceMap.ptr<Type>(y)[x];
+}
+
+// The bilinear interpolation of the distance and of its differences between the four pixels from p.
+template <typename Type, bool tiled>
+void sampleDistanceAndDiffs(const cv::Mat & distanceMap, const Vector2i & p, const Vector4f & weights, float scale,
+                            double & dis, double & dis_dx, double & dis_dy)
+{
+    const int x = p.x(), y = p.y();
+    const float d00 = distanceAt<Type, tiled>(distanceMap, x, y);
+    const float d10 = distanceAt<Type, tiled>(distanceMap, x + 1, y);
+    const float d01 = distanceAt<Type, tiled>(distanceMap, x, y + 1);
+    const float d11 = distanceAt<Type, tiled>(distanceMap, x + 1, y + 1);
+    const float d_prev_x0 = distanceAt<Type, tiled>(distanceMap, x - 1, y);
+    const float d_prev_x1 = distanceAt<Type, tiled>(distanceMap, x - 1, y + 1);
+    const float d_prev_y0 = distanceAt<Type, tiled>(distanceMap, x, y - 1);
+    const float d_prev_y1 = distanceAt<Type, tiled>(distanceMap, x + 1, y - 1);
+    dis = static_cast<double>((d00 * weights[0] + d10 * weights[1] +
+                               d01 * weights[2] + d11 * weights[3]) * scale);
+    dis_dx = static_cast<double>(((d00 - d_prev_x0) * weights[0] +
+                                  (d10 - d00) * weights[1] +
+                                  (d01 - d_prev_x1) * weights[2] +
+                                  (d11 - d01) * weights[3]) * scale);
+    dis_dy = static_cast<double>(((d00 - d_prev_y0) * weights[0] +
+                                  (d10 - d_prev_y1) * weights[1] +
+                                  (d01 - d00) * weights[2] +
+                                  (d11 - d10) * weights[3]) * scale);
+}
+
+template <typename Type, bool tiled>
+double sampleDistance(const cv::Mat & distanceMap, const Vector2i & p, const Vector4f & weights, float scale)
+{
+    const int x = p.x(), y = p.y();
+    return static_cast<double>((distanceAt<Type, tiled>(distanceMap, x, y) * weights[0] +
+                                distanceAt<Type, tiled>(distanceMap, x + 1, y) * weights[1] +
+                                distanceAt<Type, tiled>(distanceMap, x, y + 1) * weights[2] +
+                                distanceAt<Type, tiled>(distanceMap, x + 1, y + 1) * weights[3]) * scale);
+}
+
+// The bilinear interpolation of the texels (distance, d/dx, d/dy, 0) of a gradient field.
+void sampleGradientField(const cv::Mat & field, const Vector2i & p, const Vector4f & weights,
+                         double & dis, double & dis_dx, double & dis_dy)
+{
+    const float * t_ptr = field.ptr<float>(p.y(), p.x());
+    const float * t_ptr_next = field.ptr<float>(p.y() + 1, p.x());
+    Vector4f texel = Map<const Vector4f>(t_ptr) * weights[0] + Map<const Vector4f>(t_ptr + 4) * weights[1] +
+            Map<const Vector4f>(t_ptr_next) * weights[2] + Map<const Vector4f>(t_ptr_next + 4) * weights[3];
+    dis = static_cast<double>(texel[0]);
+    dis_dx = static_cast<double>(texel[1]);
+    dis_dy = static_cast<double>(texel[2]);
+}
+
+// The samplers of the kinds of the distance maps. A kind is chosen once per optimization, so the sampling
+// of the points doesn't check the layout of the map.
+template <typename Type, bool tiled>
+struct DistanceMapSampler
+{
+    static float scale()
+    {
+        return std::is_same<Type, uchar>::value ? (1.0f / compactDistanceMapScale) : 1.0f;
+    }
+
+    static void sampleDistanceAndDiffs(const cv::Mat & distanceMap, const Vector2i & p, const Vector4f & weights,
+                                       double & dis, double & dis_dx, double & dis_dy)
+    {
+        ::sampleDistanceAndDiffs<Type, tiled>(distanceMap, p, weights, scale(), dis, dis_dx, dis_dy);
+    }
+
+    static double sampleDistance(const cv::Mat & distanceMap, const Vector2i & p, const Vector4f & weights)
+    {
+        return ::sampleDistance<Type, tiled>(distanceMap, p, weights, scale());
+    }
+};
+
+struct GradientFieldSampler
+{
+    static void sampleDistanceAndDiffs(const cv::Mat & field, const Vector2i & p, const Vector4f & weights,
+                                       double & dis, double & dis_dx, double & dis_dy)
+    {
+        sampleGradientField(field, p, weights, dis, dis_dx, dis_dy);
+    }
+
+    static double sampleDistance(const cv::Mat & field, const Vector2i & p, const Vector4f & weights)
+    {
+        const float * t_ptr = field.ptr<float>(p.y(), p.x());
+        const float * t_ptr_next = field.ptr<float>(p.y() + 1, p.x());
+        return static_cast<double>(t_ptr[0] * weights[0] + t_ptr[4] * weights[1] +
+                                   t_ptr_next[0] * weights[2] + t_ptr_next[4] * weights[3]);
+    }
+};
+
+} // anonymous namespace
+
 float optimize_pose(Matrix3f & R, Vector3f & t,
                     QThreadPool * pool, size_t numberWorkThreads,
                     const cv::Mat & distanceMap,
@@ -337,6 +438,29 @@ double optimize_pose(Matrix<double, 6, 1> &x,
                      double lambdaViewPosition,
                      const Vector3d & prevViewPosition)
 {
+    return optimize_pose(x, pool, numberWorkThreads,
+                         vector<cv::Mat>(1, distanceMap), vector<int>(modelPoints.size(), 0),
+                         camera, modelPoints, maxDistance, numberIterations,
+                         lambdaViewPosition, prevViewPosition);
+}
+
+namespace {
+
+template <typename Sampler>
+double optimize_pose_sampled(Matrix<double, 6, 1> &x,
+                             QThreadPool * pool, size_t numberWorkThreads,
+                             const vector<cv::Mat> & distanceMaps,
+                             const vector<int> & distanceMapIndices,
+                             const shared_ptr<const PinholeCamera> & camera,
+                             const Vectors3f & modelPoints,
+                             double maxDistance,
+                             int numberIterations,
+                             double lambdaViewPosition,
+                             const Vector3d & prevViewPosition,
+                             PoseOptimizerBuffers * buffers)
+{
+    assert(distanceMapIndices.size() == modelPoints.size());
+
     /*double weightFunction_k2 = 1.0 / (3.0 * maxDistance * maxDistance);
     double weightFunction_k1 = 1.0 / (maxDistance * (1.0 - weightFunction_k2 * maxDistance * maxDistance));
 
@@ -382,8 +506,12 @@ double optimize_pose(Matrix<double, 6, 1> &x,
 
     Vector2d focalLength = camera->pixelFocalLength().cast<double>();
     Vector2d opticalCenter = camera->pixelOpticalCenter().cast<double>();
-    Vector2f imageCorner(static_cast<double>(distanceMap.cols - 2),
-                         static_cast<double>(distanceMap.rows - 2));
+    // The tiled maps are padded to whole tiles, the size of the image is the size of the camera.
+    Vector2i imageSize = isTiledImage(distanceMaps.front()) ? camera->imageSize() :
+                                                              Vector2i(distanceMaps.front().cols,
+                                                                       distanceMaps.front().rows);
+    Vector2f imageCorner(static_cast<float>(imageSize.x() - 2),
+                         static_cast<float>(imageSize.y() - 2));
 
     Vector3d w;
     Matrix3d R;
@@ -391,36 +519,22 @@ double optimize_pose(Matrix<double, 6, 1> &x,
     Matrix3d rW;
 
     auto getResidualAndDiffs = [&]
-            (double & dis, double & dis_dx, double & dis_dy, const Vector2f & imagePoint)
+            (double & dis, double & dis_dx, double & dis_dy,
+             const cv::Mat & distanceMap, const Vector2f & imagePoint)
     {
         Vector2i imagePoint_i = imagePoint.cast<int>();
         Vector2f sp(imagePoint.x() - static_cast<float>(imagePoint_i.x()),
                     imagePoint.y() - static_cast<float>(imagePoint_i.y()));
         Vector2f i_sp(1.0f - sp.x(), 1.0f - sp.y());
 
-        float w1 = i_sp.x() * i_sp.y();
-        float w2 = sp.x() * i_sp.y();
-        float w3 = i_sp.x() * sp.y();
-        float w4 = sp.x() * sp.y();
-
-        const float * d_ptr = distanceMap.ptr<float>(imagePoint_i.y(), imagePoint_i.x());
-        const float * d_ptr_next = distanceMap.ptr<float>(imagePoint_i.y() + 1, imagePoint_i.x());
-        dis = static_cast<double>(d_ptr[0] * w1 + d_ptr[1] * w2 +
-                                  d_ptr_next[0] * w3 + d_ptr_next[1] * w4);
-
-        const float * d_ptr_prev = distanceMap.ptr<float>(imagePoint_i.y() - 1, imagePoint_i.x());
-        dis_dx = static_cast<double>((d_ptr[0] - d_ptr[-1]) * w1 +
-                                     (d_ptr[1] - d_ptr[0]) * w2 +
-                                     (d_ptr_next[0] - d_ptr_next[-1]) * w3 +
-                                     (d_ptr_next[1] - d_ptr_next[0]) * w4);
-        dis_dy = static_cast<double>((d_ptr[0] - d_ptr_prev[0]) * w1 +
-                                     (d_ptr[1] - d_ptr_prev[1]) * w2 +
-                                     (d_ptr_next[0] - d_ptr[0]) * w3 +
-                                     (d_ptr_next[1] - d_ptr[1]) * w4);
+        Vector4f weights(i_sp.x() * i_sp.y(), sp.x() * i_sp.y(), i_sp.x() * sp.y(), sp.x() * sp.y());
+
+        Sampler::sampleDistanceAndDiffs(distanceMap, imagePoint_i, weights, dis, dis_dx, dis_dy);
     };
 
     auto getJacobianAndResidual = [&]
-            (Matrix<double, 1, 6> & J, double & e, const Vector3f & point) -> bool
+            (Matrix<double, 1, 6> & J, double & e,
+             const cv::Mat & distanceMap, const Vector3f & point) -> bool
     {
         Matrix3d rJ = R * skewMatrix(point.cast<double>().eval()) * rW;
         //Matrix3d rJ = exp_jacobian(w, point.cast<double>().eval());
@@ -459,7 +573,7 @@ double optimize_pose(Matrix<double, 6, 1> &x,
         }
 
         double dis, dis_dx, dis_dy;
-        getResidualAndDiffs(dis, dis_dx, dis_dy, imagePoint);
+        getResidualAndDiffs(dis, dis_dx, dis_dy, distanceMap, imagePoint);
 
         e = weightFunction(dis);
         //if (e == 0.0)
@@ -470,7 +584,7 @@ double optimize_pose(Matrix<double, 6, 1> &x,
         return true;
     };
 
-    auto getResidual = [&] (double & e, const Vector3f & point) -> bool
+    auto getResidual = [&] (double & e, const cv::Mat & distanceMap, const Vector3f & point) -> bool
     {
         Vector3d v = R * point.cast<double>() + t;
         if (v.z() < 1e-5)
@@ -491,15 +605,9 @@ double optimize_pose(Matrix<double, 6, 1> &x,
                     imagePoint.y() - static_cast<float>(imagePoint_i.y()));
         Vector2f i_sp(1.0f - sp.x(), 1.0f - sp.y());
 
-        float w1 = i_sp.x() * i_sp.y();
-        float w2 = sp.x() * i_sp.y();
-        float w3 = i_sp.x() * sp.y();
-        float w4 = sp.x() * sp.y();
+        Vector4f weights(i_sp.x() * i_sp.y(), sp.x() * i_sp.y(), i_sp.x() * sp.y(), sp.x() * sp.y());
 
-        const float * d_ptr = distanceMap.ptr<float>(imagePoint_i.y(), imagePoint_i.x());
-        const float * d_ptr_next = distanceMap.ptr<float>(imagePoint_i.y() + 1, imagePoint_i.x());
-        double dis = static_cast<double>(d_ptr[0] * w1 + d_ptr[1] * w2 +
-                                         d_ptr_next[0] * w3 + d_ptr_next[1] * w4);
+        double dis = Sampler::sampleDistance(distanceMap, imagePoint_i, weights);
 
         e = weightFunction(dis);
         //if (e == 0.0)
@@ -507,7 +615,7 @@ double optimize_pose(Matrix<double, 6, 1> &x,
         return true;
     };
 
-    using MinimizationInfo = tuple<Matrix<double, 6, 6>, Matrix<double, 6, 1>, double, size_t>;
+    using MinimizationInfo = PoseOptimizerBuffers::MinimizationInfo;
     auto computeMinimzationInfo = [&] (size_t begin_index, size_t end_index) -> MinimizationInfo
     {
         size_t count = 0;
@@ -518,7 +626,7 @@ double optimize_pose(Matrix<double, 6, 1> &x,
         double e;
         for (size_t i = begin_index; i < end_index; ++i)
         {
-            if (!getJacobianAndResidual(J_i, e, modelPoints[i]))
+            if (!getJacobianAndResidual(J_i, e, distanceMaps[static_cast<size_t>(distanceMapIndices[i])], modelPoints[i]))
             {
                 //pixelError += maxDistance * maxDistance;
                 //++count;
@@ -537,7 +645,7 @@ double optimize_pose(Matrix<double, 6, 1> &x,
         double Fsq = 0.0, e;
         for (size_t i = begin_index; i < end_index; ++i)
         {
-            if (!getResidual(e, modelPoints[i]))
+            if (!getResidual(e, distanceMaps[static_cast<size_t>(distanceMapIndices[i])], modelPoints[i]))
             {
                 //Fsq += maxDistance * maxDistance;
                 //++count;
@@ -557,6 +665,13 @@ double optimize_pose(Matrix<double, 6, 1> &x,
 
     QSemaphore semaphore;
     size_t workPartSize = static_cast<size_t>(ceil(numberPoints / static_cast<float>(numberWorkThreads)));
+    // The results of the work parts are allocated once for all the iterations, or not at all with the buffers
+    // of the caller.
+    PoseOptimizerBuffers localBuffers;
+    if (!buffers)
+        buffers = &localBuffers;
+    buffers->minimizationResults.resize(numberWorkThreads);
+    buffers->residualResults.resize(numberWorkThreads);
 
     for (int iter = 0; iter < numberIterations; ++iter)
     {
@@ -579,17 +694,23 @@ double optimize_pose(Matrix<double, 6, 1> &x,
         pixelError = 0.0;
         size_t count = 0;
         {
-            vector<MinimizationInfo> results(numberWorkThreads);
-            for (size_t i = 0; i < numberWorkThreads; ++i)
+            auto & results = buffers->minimizationResults;
+            auto computePart = [&] (size_t i)
+            {
+                size_t begin_index = i * workPartSize;
+                size_t end_index = min(begin_index + workPartSize, numberPoints);
+                results[i] = computeMinimzationInfo(begin_index, end_index);
+            };
+            for (size_t i = 0; i + 1 < numberWorkThreads; ++i)
             {
                 QtConcurrent::run(pool, [&, i] () {
-                    size_t begin_index = i * workPartSize;
-                    size_t end_index = min(begin_index + workPartSize, numberPoints);
-                    results[i] = computeMinimzationInfo(begin_index, end_index);
+                    computePart(i);
                     semaphore.release();
                 });
             }
-            semaphore.acquire(static_cast<int>(numberWorkThreads));
+            // The calling thread would wait anyway, so it takes the last part.
+            computePart(numberWorkThreads - 1);
+            semaphore.acquire(static_cast<int>(numberWorkThreads - 1));
             for (size_t i = 0; i < numberWorkThreads; ++i)
             {
                 const MinimizationInfo & info = results[i];
@@ -657,17 +778,22 @@ double optimize_pose(Matrix<double, 6, 1> &x,
             count = 0;
             pixelError_next = 0.0;
             {
-                vector<tuple<double, size_t>> results(numberWorkThreads);
-                for (size_t i = 0; i < numberWorkThreads; ++i)
+                vector<tuple<double, size_t>> & results = buffers->residualResults;
+                auto computePart = [&] (size_t i)
+                {
+                    size_t begin_index = i * workPartSize;
+                    size_t end_index = min(begin_index + workPartSize, numberPoints);
+                    results[i] = computeResiduals(begin_index, end_index);
+                };
+                for (size_t i = 0; i + 1 < numberWorkThreads; ++i)
                 {
                     QtConcurrent::run(pool, [&, i] () {
-                        size_t begin_index = i * workPartSize;
-                        size_t end_index = min(begin_index + workPartSize, numberPoints);
-                        results[i] = computeResiduals(begin_index, end_index);
+                        computePart(i);
                         semaphore.release();
                     });
                 }
-                semaphore.acquire(static_cast<int>(numberWorkThreads));
+                computePart(numberWorkThreads - 1);
+                semaphore.acquire(static_cast<int>(numberWorkThreads - 1));
                 for (size_t i = 0; i < numberWorkThreads; ++i)
                 {
                     pixelError_next += get<0>(results[i]);
@@ -709,3 +835,61 @@ double optimize_pose(Matrix<double, 6, 1> &x,
     double E = get_x_weightFunction(sqrt(pixelError));
     return E;
 }
+
+} // anonymous namespace
+
+double optimize_pose(Matrix<double, 6, 1> &x,
+                     QThreadPool * pool, size_t numberWorkThreads,
+                     const vector<cv::Mat> & distanceMaps,
+                     const vector<int> & distanceMapIndices,
+                     const shared_ptr<const PinholeCamera> & camera,
+                     const Vectors3f & modelPoints,
+                     double maxDistance,
+                     int numberIterations,
+                     double lambdaViewPosition,
+                     const Vector3d & prevViewPosition,
+                     PoseOptimizerBuffers * buffers)
+{
+    // The maps of the orientation channels are made by the same steps, so they are of the same kind.
+    const cv::Mat & distanceMap = distanceMaps.front();
+    if (distanceMap.type() == CV_32FC4)
+    {
+        return optimize_pose_sampled<GradientFieldSampler>(x, pool, numberWorkThreads,
+                                                           distanceMaps, distanceMapIndices,
+                                                           camera, modelPoints, maxDistance, numberIterations,
+                                                           lambdaViewPosition, prevViewPosition, buffers);
+    }
+    if (isTiledImage(distanceMap))
+    {
+        if (distanceMap.depth() == CV_8U)
+        {
+            return optimize_pose_sampled<DistanceMapSampler<uchar, true>>(x, pool, numberWorkThreads,
+                                                                         distanceMaps, distanceMapIndices,
+                                                                         camera, modelPoints, maxDistance,
+                                                                         numberIterations,
+                                                                         lambdaViewPosition, prevViewPosition,
+                                                                         buffers);
+        }
+        return optimize_pose_sampled<DistanceMapSampler<float, true>>(x, pool, numberWorkThreads,
+                                                                     distanceMaps, distanceMapIndices,
+                                                                     camera, modelPoints, maxDistance,
+                                                                     numberIterations,
+                                                                     lambdaViewPosition, prevViewPosition,
+                                                                     buffers);
+    }
+    if (distanceMap.depth() == CV_8U)
+    {
+        return optimize_pose_sampled<DistanceMapSampler<uchar, false>>(x, pool, numberWorkThreads,
+                                                                      distanceMaps, distanceMapIndices,
+                                                                      camera, modelPoints, maxDistance,
+                                                                      numberIterations,
+                                                                      lambdaViewPosition, prevViewPosition,
+                                                                      buffers);
+    }
+    return optimize_pose_sampled<DistanceMapSampler<float, false>>(x, pool, numberWorkThreads,
+                                                                  distanceMaps, distanceMapIndices,
+                                                                  camera, modelPoints, maxDistance,
+                                                                  numberIterations,
+                                                                  lambdaViewPosition, prevViewPosition,
+                                                                  buffers);
+}
@@ -2,6 +2,8 @@
 #define POSEOPTIMIZER_H
 
 #include <memory>
+#include <vector>
+#include <tuple>
 
 #include <QThreadPool>
 
@@ -13,6 +15,22 @@
 
 class PinholeCamera;
 
+// The distance maps are CV_32F in pixels or compact CV_8U in steps of 1 / compactDistanceMapScale of a pixel,
+// which saturate at 255 / compactDistanceMapScale, beyond the largest distance taken into account.
+// Both can be tiled by tileImage(), then the size of the image is taken from the camera.
+// A CV_32FC4 map is a field of distances with their differences, see distanceGradientField().
+const float compactDistanceMapScale = 8.0f;
+
+// The results of the work parts of optimize_pose(), a caller which keeps them between the frames
+// doesn't allocate them again.
+struct PoseOptimizerBuffers
+{
+    using MinimizationInfo = std::tuple<Eigen::Matrix<double, 6, 6>, Eigen::Matrix<double, 6, 1>, double, size_t>;
+
+    std::vector<MinimizationInfo, Eigen::aligned_allocator<MinimizationInfo>> minimizationResults;
+    std::vector<std::tuple<double, size_t>> residualResults;
+};
+
 void test_transfroms();
 
 Eigen::Matrix3f skewMatrix(const Eigen::Vector3f & a);
@@ -48,4 +66,18 @@ double optimize_pose(Eigen::Matrix<double, 6, 1> & x,
                      double lambdaViewPosition = -1.0,
                      const Eigen::Vector3d & prevViewPosition = Eigen::Vector3d::Zero());
 
+// Every model point is matched with the distance map of its index in distanceMapIndices,
+// e.g. with the distance map of the image edges of the same orientation.
+double optimize_pose(Eigen::Matrix<double, 6, 1> & x,
+                     QThreadPool * pool, size_t numberWorkThreads,
+                     const std::vector<cv::Mat> & distanceMaps,
+                     const std::vector<int> & distanceMapIndices,
+                     const std::shared_ptr<const PinholeCamera> & camera,
+                     const Vectors3f & modelPoints,
+                     double maxDistance,
+                     int numberIterations,
+                     double lambdaViewPosition = -1.0,
+                     const Eigen::Vector3d & prevViewPosition = Eigen::Vector3d::Zero(),
+                     PoseOptimizerBuffers * buffers = nullptr);
+
 #endif // POSEOPTIMIZER_H
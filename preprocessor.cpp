@@ -0,0 +1,329 @@
+#include "preprocessor.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include "parallelstripes.h"
+
+using namespace std;
+
+namespace {
+
+// Lower stripes would spend more time on the rows around them than on their own ones.
+const int min_stripe_rows = 16;
+
+// The index of a row or a column beyond the border, as with cv::BORDER_REFLECT_101.
+int reflect101(int i, int size)
+{
+    if (size == 1)
+        return 0;
+    if (i < 0)
+        return - i;
+    if (i >= size)
+        return 2 * size - 2 - i;
+    return i;
+}
+
+void laplacianRow(const cv::Mat & image, int y, uchar * dst)
+{
+    // The kernel is the 3x3 box without nine centers, the result is saturated as by convertTo(CV_8U).
+    const uchar * up = image.ptr<uchar>(reflect101(y - 1, image.rows));
+    const uchar * row = image.ptr<uchar>(y);
+    const uchar * down = image.ptr<uchar>(reflect101(y + 1, image.rows));
+    int cols = image.cols;
+    auto columnSum = [&] (int x) -> int
+    {
+        return up[x] + row[x] + down[x];
+    };
+    int left = columnSum(reflect101(- 1, cols));
+    int center = columnSum(0);
+    for (int x = 0; x < cols; ++x)
+    {
+        int right = columnSum(reflect101(x + 1, cols));
+        int value = left + center + right - 9 * row[x];
+        dst[x] = static_cast<uchar>(min(max(value, 0), 255));
+        left = center;
+        center = right;
+    }
+}
+
+// The missing rows beyond the border are passed as the middle row, so they don't change the result.
+void dilateCrossRow(const uchar * up, const uchar * row, const uchar * down, uchar * dst, int cols)
+{
+    if (cols == 1)
+    {
+        dst[0] = max(max(up[0], down[0]), row[0]);
+        return;
+    }
+    dst[0] = max(max(up[0], down[0]), max(row[0], row[1]));
+    for (int x = 1; x < cols - 1; ++x)
+        dst[x] = max(max(up[x], down[x]), max(max(row[x - 1], row[x]), row[x + 1]));
+    dst[cols - 1] = max(max(up[cols - 1], down[cols - 1]), max(row[cols - 2], row[cols - 1]));
+}
+
+void erodeRectInvertRow(const uchar * up, const uchar * row, const uchar * down,
+                        uchar * columnMins, uchar * dst, int cols)
+{
+    for (int x = 0; x < cols; ++x)
+        columnMins[x] = min(min(up[x], down[x]), row[x]);
+    if (cols == 1)
+    {
+        dst[0] = static_cast<uchar>(255 - columnMins[0]);
+        return;
+    }
+    dst[0] = static_cast<uchar>(255 - min(columnMins[0], columnMins[1]));
+    for (int x = 1; x < cols - 1; ++x)
+        dst[x] = static_cast<uchar>(255 - min(min(columnMins[x - 1], columnMins[x]), columnMins[x + 1]));
+    dst[cols - 1] = static_cast<uchar>(255 - min(columnMins[cols - 2], columnMins[cols - 1]));
+}
+
+} // anonymous namespace
+
+void Preprocessor::binarize(const cv::Mat & image, cv::Mat & binImage, const Settings & settings,
+                            QThreadPool * pool, size_t numberStripes)
+{
+    CV_Assert(image.type() == CV_8UC1);
+    CV_Assert(binImage.data != image.data);
+
+    if (settings.useAdaptiveBinarization)
+    {
+        CV_Assert((settings.adaptiveBinarizationWinSize % 2 == 1) && (settings.adaptiveBinarizationWinSize > 1));
+        // As cv::adaptiveThreshold with THRESH_BINARY: the value minus the mean is greater than minus the constant.
+        int delta = static_cast<int>(ceil(settings.threshold));
+        m_lut.resize(511);
+        for (int i = 0; i < 511; ++i)
+            m_lut[static_cast<size_t>(i)] = (i - 255 > - delta) ? 255 : 0;
+    }
+    else
+    {
+        // As cv::threshold with THRESH_BINARY, which floors the threshold of 8-bit images.
+        int threshold = static_cast<int>(floor(settings.threshold));
+        m_lut.resize(256);
+        for (int i = 0; i < 256; ++i)
+            m_lut[static_cast<size_t>(i)] = (i > threshold) ? 255 : 0;
+    }
+
+    binImage.create(image.rows, image.cols, CV_8UC1);
+    if ((image.rows == 0) || (image.cols == 0))
+        return;
+
+    // The adaptive binarization takes the means from the integral image of the whole source,
+    // so the Laplacian is computed beforehand and is streamed only into the global threshold.
+    const cv::Mat * source = &image;
+    if (settings.useAdaptiveBinarization)
+    {
+        if (settings.useLaplacian)
+        {
+            m_laplacianImage.create(image.rows, image.cols, CV_8UC1);
+            parallelStripes(pool, numberStripes, image.rows, min_stripe_rows,
+                            [&] (size_t, int beginRow, int endRow)
+            {
+                for (int y = beginRow; y < endRow; ++y)
+                    laplacianRow(image, y, m_laplacianImage.ptr<uchar>(y));
+            });
+            source = &m_laplacianImage;
+        }
+        m_integralImage.compute(*source);
+    }
+
+    int variant = ((settings.useLaplacian && !settings.useAdaptiveBinarization) ? 4 : 0) |
+            (settings.useAdaptiveBinarization ? 2 : 0) | (settings.useDilate ? 1 : 0);
+    m_lineBuffers.resize(max(numberStripes, static_cast<size_t>(1)));
+    parallelStripes(pool, numberStripes, image.rows, min_stripe_rows,
+                    [&] (size_t stripeIndex, int beginRow, int endRow)
+    {
+        LineBuffers & buffers = m_lineBuffers[stripeIndex];
+        switch (variant)
+        {
+        case 0: _binarize<false, false, false>(*source, binImage, settings, buffers, beginRow, endRow); break;
+        case 1: _binarize<false, false, true>(*source, binImage, settings, buffers, beginRow, endRow); break;
+        case 2: _binarize<false, true, false>(*source, binImage, settings, buffers, beginRow, endRow); break;
+        case 3: _binarize<false, true, true>(*source, binImage, settings, buffers, beginRow, endRow); break;
+        case 4: _binarize<true, false, false>(*source, binImage, settings, buffers, beginRow, endRow); break;
+        default: _binarize<true, false, true>(*source, binImage, settings, buffers, beginRow, endRow); break;
+        }
+    });
+}
+
+void Preprocessor::sampleHistogram(const cv::Mat & image, bool useLaplacian, int sampleStep,
+                                   vector<int> & histogram, const IntegralImage * integralImage)
+{
+    CV_Assert(image.type() == CV_8UC1);
+    CV_Assert(sampleStep > 0);
+
+    histogram.assign(256, 0);
+    if (!useLaplacian && integralImage)
+    {
+        // Every pixel counts in the mean of its cell, which costs four lookups whatever the step.
+        for (int y = 0; y < image.rows; y += sampleStep)
+        {
+            int cellRows = min(sampleStep, image.rows - y);
+            for (int x = 0; x < image.cols; x += sampleStep)
+            {
+                cv::Rect cell(x, y, min(sampleStep, image.cols - x), cellRows);
+                ++histogram[static_cast<size_t>(cvRound(integralImage->mean(cell)))];
+            }
+        }
+        return;
+    }
+
+    m_lineBuffers.resize(max(m_lineBuffers.size(), static_cast<size_t>(1)));
+    vector<uchar> & laplacianRowBuffer = m_lineBuffers[0].sourceRows;
+    if (useLaplacian)
+        laplacianRowBuffer.resize(static_cast<size_t>(image.cols));
+    for (int y = sampleStep / 2; y < image.rows; y += sampleStep)
+    {
+        const uchar * row = image.ptr<uchar>(y);
+        if (useLaplacian)
+        {
+            laplacianRow(image, y, laplacianRowBuffer.data());
+            row = laplacianRowBuffer.data();
+        }
+        for (int x = sampleStep / 2; x < image.cols; x += sampleStep)
+            ++histogram[row[x]];
+    }
+}
+
+const IntegralImage & Preprocessor::integralImage() const
+{
+    return m_integralImage;
+}
+
+void Preprocessor::makeEdges(const cv::Size & size, cv::Mat & edges, bool useErode, const GetRow & getRow,
+                             QThreadPool * pool, size_t numberStripes)
+{
+    edges.create(size, CV_8UC1);
+    if ((size.width == 0) || (size.height == 0))
+        return;
+
+    m_lineBuffers.resize(max(numberStripes, static_cast<size_t>(1)));
+    parallelStripes(pool, numberStripes, size.height, min_stripe_rows,
+                    [&] (size_t stripeIndex, int beginRow, int endRow)
+    {
+        LineBuffers & buffers = m_lineBuffers[stripeIndex];
+        if (useErode)
+            _makeEdges<true>(edges, getRow, buffers, beginRow, endRow);
+        else
+            _makeEdges<false>(edges, getRow, buffers, beginRow, endRow);
+    });
+}
+
+template <bool useLaplacian, bool useAdaptiveBinarization, bool useDilate>
+void Preprocessor::_binarize(const cv::Mat & image, cv::Mat & binImage, const Settings & settings,
+                             LineBuffers & buffers, int beginRow, int endRow) const
+{
+    int rows = image.rows, cols = image.cols;
+    size_t rowSize = static_cast<size_t>(cols);
+
+    // The dilation of the stripe needs the binary rows just above and below it.
+    int firstRow = useDilate ? max(beginRow - 1, 0) : beginRow;
+    int lastRow = useDilate ? min(endRow + 1, rows) : endRow;
+
+    if (useLaplacian)
+        buffers.sourceRows.resize(rowSize);
+    auto getSourceRow = [&] (int y) -> const uchar *
+    {
+        if (!useLaplacian)
+            return image.ptr<uchar>(y);
+        laplacianRow(image, y, buffers.sourceRows.data());
+        return buffers.sourceRows.data();
+    };
+
+    int radius = useAdaptiveBinarization ? (settings.adaptiveBinarizationWinSize / 2) : 0;
+    if (useAdaptiveBinarization)
+    {
+        buffers.boxPrefixes.resize(rowSize + 1);
+        buffers.boxSums.resize(rowSize);
+    }
+    // The mean is rounded as by the normalized cv::boxFilter with BORDER_REPLICATE. An odd window never gives a tie.
+    const double meanScale = 1.0 / static_cast<double>((2 * radius + 1) * (2 * radius + 1));
+    const uchar * lut = m_lut.data();
+    auto binarizeRow = [&] (int y, uchar * dst)
+    {
+        const uchar * src = getSourceRow(y);
+        if (!useAdaptiveBinarization)
+        {
+            for (int x = 0; x < cols; ++x)
+                dst[x] = lut[src[x]];
+            return;
+        }
+        const int * boxSums = buffers.boxSums.data();
+        m_integralImage.replicatedBoxSums(y, radius, buffers.boxPrefixes.data(), buffers.boxSums.data());
+        for (int x = 0; x < cols; ++x)
+        {
+            int mean = static_cast<int>(boxSums[x] * meanScale + 0.5);
+            dst[x] = lut[src[x] - mean + 255];
+        }
+    };
+
+    if (!useDilate)
+    {
+        for (int y = beginRow; y < endRow; ++y)
+            binarizeRow(y, binImage.ptr<uchar>(y));
+        return;
+    }
+
+    buffers.binaryRows.resize(3 * rowSize);
+    auto getBinaryRow = [&] (int y) -> uchar *
+    {
+        return &buffers.binaryRows[static_cast<size_t>(y % 3) * rowSize];
+    };
+    auto dilateRow = [&] (int y)
+    {
+        const uchar * row = getBinaryRow(y);
+        dilateCrossRow((y > 0) ? getBinaryRow(y - 1) : row, row, (y + 1 < rows) ? getBinaryRow(y + 1) : row,
+                       binImage.ptr<uchar>(y), cols);
+    };
+    for (int y = firstRow; y < lastRow; ++y)
+    {
+        binarizeRow(y, getBinaryRow(y));
+        if ((y - 1 >= beginRow) && (y - 1 < endRow))
+            dilateRow(y - 1);
+    }
+    if (lastRow == endRow)
+        dilateRow(endRow - 1);
+}
+
+template <bool useErode>
+void Preprocessor::_makeEdges(cv::Mat & edges, const GetRow & getRow,
+                              LineBuffers & buffers, int beginRow, int endRow) const
+{
+    int rows = edges.rows, cols = edges.cols;
+    size_t rowSize = static_cast<size_t>(cols);
+
+    if (!useErode)
+    {
+        for (int y = beginRow; y < endRow; ++y)
+        {
+            uchar * row = edges.ptr<uchar>(y);
+            getRow(y, row);
+            for (int x = 0; x < cols; ++x)
+                row[x] = static_cast<uchar>(255 - row[x]);
+        }
+        return;
+    }
+
+    // The erosion of the stripe needs the rows just above and below it.
+    int firstRow = max(beginRow - 1, 0);
+    int lastRow = min(endRow + 1, rows);
+    buffers.binaryRows.resize(4 * rowSize);
+    uchar * columnMins = &buffers.binaryRows[3 * rowSize];
+    auto getBinaryRow = [&] (int y) -> uchar *
+    {
+        return &buffers.binaryRows[static_cast<size_t>(y % 3) * rowSize];
+    };
+    auto erodeRow = [&] (int y)
+    {
+        const uchar * row = getBinaryRow(y);
+        erodeRectInvertRow((y > 0) ? getBinaryRow(y - 1) : row, row, (y + 1 < rows) ? getBinaryRow(y + 1) : row,
+                           columnMins, edges.ptr<uchar>(y), cols);
+    };
+    for (int y = firstRow; y < lastRow; ++y)
+    {
+        getRow(y, getBinaryRow(y));
+        if ((y - 1 >= beginRow) && (y - 1 < endRow))
+            erodeRow(y - 1);
+    }
+    if (lastRow == endRow)
+        erodeRow(endRow - 1);
+}
@@ -0,0 +1,74 @@
+#ifndef PREPROCESSOR_H
+#define PREPROCESSOR_H
+
+#include <vector>
+#include <functional>
+
+#include <QThreadPool>
+
+#include <opencv2/core.hpp>
+
+#include "integralimage.h"
+
+// Streams image rows through the preprocessing stages of the tracker with a few line buffers,
+// so every stage chain reads and writes each pixel once. The result of every stage is the same
+// as of the OpenCV function it replaces. The rows are split into stripes which are processed
+// on the pool, every stripe recomputes the few rows around it that the neighbourhoods need.
+class Preprocessor
+{
+public:
+    struct Settings
+    {
+        bool useLaplacian;
+        bool useAdaptiveBinarization;
+        int adaptiveBinarizationWinSize;
+        // The threshold of the binarization or, for the adaptive one, the constant subtracted from the mean.
+        double threshold;
+        bool useDilate;
+    };
+
+    using GetRow = std::function<void(int y, uchar * row)>;
+
+    // Laplacian (filter2D with the 3x3 Laplacian kernel), threshold or adaptiveThreshold (MEAN_C)
+    // and dilation with the 3x3 cross.
+    void binarize(const cv::Mat & image, cv::Mat & binImage, const Settings & settings,
+                  QThreadPool * pool, size_t numberStripes);
+
+    // The histogram of the source of the binarization, the image or its Laplacian,
+    // sampled at every sampleStep-th pixel of every sampleStep-th row. If the integral image of the image
+    // is already computed, the histogram of the image takes the means of the sampleStep x sampleStep cells from it.
+    void sampleHistogram(const cv::Mat & image, bool useLaplacian, int sampleStep, std::vector<int> & histogram,
+                         const IntegralImage * integralImage = nullptr);
+
+    // The integral image of the source of the last adaptive binarization.
+    const IntegralImage & integralImage() const;
+
+    // Erosion with the 3x3 rectangle and inversion of the rows which are given by getRow.
+    // The rows are requested in order within a stripe, from several threads and a few of them twice.
+    void makeEdges(const cv::Size & size, cv::Mat & edges, bool useErode, const GetRow & getRow,
+                   QThreadPool * pool, size_t numberStripes);
+
+private:
+    struct LineBuffers
+    {
+        std::vector<uchar> sourceRows;
+        std::vector<uchar> binaryRows;
+        std::vector<int> boxPrefixes;
+        std::vector<int> boxSums;
+    };
+
+    std::vector<LineBuffers> m_lineBuffers;
+    std::vector<uchar> m_lut;
+    cv::Mat m_laplacianImage;
+    IntegralImage m_integralImage;
+
+    template <bool useLaplacian, bool useAdaptiveBinarization, bool useDilate>
+    void _binarize(const cv::Mat & image, cv::Mat & binImage, const Settings & settings,
+                   LineBuffers & buffers, int beginRow, int endRow) const;
+
+    template <bool useErode>
+    void _makeEdges(cv::Mat & edges, const GetRow & getRow,
+                    LineBuffers & buffers, int beginRow, int endRow) const;
+};
+
+#endif // PREPROCESSOR_H
@@ -17,11 +17,24 @@ Item {
         property double binaryThreshold: 100.0
         property double minBlobArea: 30.0
         property double maxBlobCircularity: 0.25
+        property double distanceBandRadius: 0.0
+        property int numberOrientationChannels: 0
         property bool useLaplacian: false
         property bool useAdaptiveBinarization: false
         property int adaptiveBinarizationWinSize: 31
         property bool useDilate: false
         property bool useErode: false
+        property bool useBlobLabeling: true
+        property bool useRegionOfInterest: false
+        property bool usePosePrediction: true
+        property bool usePipelining: false
+        property bool useAutoThreshold: false
+        property bool useCompactDistanceMap: false
+        property bool useTiledDistanceMap: false
+        property bool useDistanceGradients: false
+        property bool useExactDistanceTransform: false
+        property bool useModelGuidedFiltering: false
+        property double modelProximity: 30.0
     }
 
     states: [
@@ -115,9 +128,22 @@ Item {
             adaptiveBinarizationWinSize: settings.adaptiveBinarizationWinSize
             useDilate: settings.useDilate
             useErode: settings.useErode
+            useBlobLabeling: settings.useBlobLabeling
+            useRegionOfInterest: settings.useRegionOfInterest
+            usePosePrediction: settings.usePosePrediction
+            usePipelining: settings.usePipelining
+            useAutoThreshold: settings.useAutoThreshold
+            useCompactDistanceMap: settings.useCompactDistanceMap
+            useTiledDistanceMap: settings.useTiledDistanceMap
+            useDistanceGradients: settings.useDistanceGradients
+            useExactDistanceTransform: settings.useExactDistanceTransform
+            useModelGuidedFiltering: settings.useModelGuidedFiltering
             binaryThreshold: settings.binaryThreshold
             minBlobArea: settings.minBlobArea
             maxBlobCircularity: settings.maxBlobCircularity
+            distanceBandRadius: settings.distanceBandRadius
+            numberOrientationChannels: settings.numberOrientationChannels
+            modelProximity: settings.modelProximity
         }
         gl_view: gl_view
         textureReceiver: frameTextureReceiver
@@ -191,13 +217,16 @@ Item {
 
                 Text {
                     Layout.fillWidth: true
-                    text: "Binary threshold"
+                    text: settings.useAutoThreshold ?
+                              ("Binary threshold: " + Math.round(frameHandler.objectEdgesTracker.autoBinaryThreshold)) :
+                              "Binary threshold"
                     font.pointSize: 12
                     color: "white"
                 }
 
                 Slider {
                     Layout.fillWidth: true
+                    enabled: !settings.useAutoThreshold
                     from: 0.0
                     to: 255.0
                     value: settings.binaryThreshold
@@ -207,6 +236,20 @@ Item {
                 }
             }
 
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+
+                CheckBox {
+                    text: "Use auto threshold"
+                    Layout.fillWidth: true
+                    checkState: settings.useAutoThreshold ? Qt.Checked : Qt.Unchecked
+                    onCheckStateChanged: {
+                        settings.useAutoThreshold = (checkState === Qt.Checked)
+                    }
+                }
+            }
+
             RowLayout {
                 Layout.fillWidth: true
                 spacing: 10
@@ -251,6 +294,74 @@ Item {
                 }
             }
 
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+
+                Text {
+                    Layout.fillWidth: true
+                    text: "Distance band radius"
+                    font.pointSize: 12
+                    color: "white"
+                }
+
+                Slider {
+                    Layout.fillWidth: true
+                    from: 0.0
+                    to: 100.0
+                    value: settings.distanceBandRadius
+                    onValueChanged: {
+                        settings.distanceBandRadius = value
+                    }
+                }
+            }
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+
+                Text {
+                    Layout.fillWidth: true
+                    text: "Orientation channels"
+                    font.pointSize: 12
+                    color: "white"
+                }
+
+                Slider {
+                    Layout.fillWidth: true
+                    from: 0
+                    to: 12
+                    stepSize: 1
+                    value: settings.numberOrientationChannels
+                    onValueChanged: {
+                        settings.numberOrientationChannels = Math.floor(value)
+                    }
+                }
+            }
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+
+                Text {
+                    Layout.fillWidth: true
+                    text: "Model proximity"
+                    font.pointSize: 12
+                    color: "white"
+                }
+
+                Slider {
+                    Layout.fillWidth: true
+                    enabled: settings.useModelGuidedFiltering
+                    from: 5.0
+                    to: 100.0
+                    value: settings.modelProximity
+                    onValueChanged: {
+                        settings.modelProximity = value
+                    }
+                }
+            }
+
             RowLayout {
                 Layout.fillWidth: true
                 spacing: 10
@@ -329,6 +440,132 @@ Item {
                     }
                 }
             }
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+
+                CheckBox {
+                    text: "Use blob labeling"
+                    Layout.fillWidth: true
+                    checkState: settings.useBlobLabeling ? Qt.Checked : Qt.Unchecked
+                    onCheckStateChanged: {
+                        settings.useBlobLabeling = (checkState === Qt.Checked)
+                    }
+                }
+            }
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+
+                CheckBox {
+                    text: "Use region of interest"
+                    Layout.fillWidth: true
+                    checkState: settings.useRegionOfInterest ? Qt.Checked : Qt.Unchecked
+                    onCheckStateChanged: {
+                        settings.useRegionOfInterest = (checkState === Qt.Checked)
+                    }
+                }
+            }
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+
+                CheckBox {
+                    text: "Use pose prediction"
+                    Layout.fillWidth: true
+                    checkState: settings.usePosePrediction ? Qt.Checked : Qt.Unchecked
+                    onCheckStateChanged: {
+                        settings.usePosePrediction = (checkState === Qt.Checked)
+                    }
+                }
+            }
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+
+                CheckBox {
+                    text: "Use pipelining"
+                    Layout.fillWidth: true
+                    checkState: settings.usePipelining ? Qt.Checked : Qt.Unchecked
+                    onCheckStateChanged: {
+                        settings.usePipelining = (checkState === Qt.Checked)
+                    }
+                }
+            }
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+
+                CheckBox {
+                    text: "Use compact distance map"
+                    Layout.fillWidth: true
+                    checkState: settings.useCompactDistanceMap ? Qt.Checked : Qt.Unchecked
+                    onCheckStateChanged: {
+                        settings.useCompactDistanceMap = (checkState === Qt.Checked)
+                    }
+                }
+            }
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+
+                CheckBox {
+                    text: "Use tiled distance map"
+                    Layout.fillWidth: true
+                    checkState: settings.useTiledDistanceMap ? Qt.Checked : Qt.Unchecked
+                    onCheckStateChanged: {
+                        settings.useTiledDistanceMap = (checkState === Qt.Checked)
+                    }
+                }
+            }
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+
+                CheckBox {
+                    text: "Use distance gradients"
+                    Layout.fillWidth: true
+                    checkState: settings.useDistanceGradients ? Qt.Checked : Qt.Unchecked
+                    onCheckStateChanged: {
+                        settings.useDistanceGradients = (checkState === Qt.Checked)
+                    }
+                }
+            }
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+
+                CheckBox {
+                    text: "Use exact distance transform"
+                    Layout.fillWidth: true
+                    checkState: settings.useExactDistanceTransform ? Qt.Checked : Qt.Unchecked
+                    onCheckStateChanged: {
+                        settings.useExactDistanceTransform = (checkState === Qt.Checked)
+                    }
+                }
+            }
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+
+                CheckBox {
+                    text: "Use model-guided filtering"
+                    Layout.fillWidth: true
+                    checkState: settings.useModelGuidedFiltering ? Qt.Checked : Qt.Unchecked
+                    onCheckStateChanged: {
+                        settings.useModelGuidedFiltering = (checkState === Qt.Checked)
+                    }
+                }
+            }
         }
     }
 
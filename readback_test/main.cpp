@@ -0,0 +1,165 @@
+#include <chrono>
+
+#include <QtTest>
+#include <QGuiApplication>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QSurfaceFormat>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "texture2grayimageconvertor.h"
+
+// Checks that the gray image read back from the GPU is equal pixel by pixel to
+// cv::cvtColor(RGBA2GRAY) of the texture for every readback mode.
+class ReadbackTest: public QObject
+{
+    Q_OBJECT
+
+public:
+    ReadbackTest();
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void readback_data();
+    void readback();
+
+private:
+    QOffscreenSurface m_surface;
+    QOpenGLContext m_context;
+    QOpenGLFunctions * m_gl;
+    GLuint m_textureId;
+
+    cv::Mat _createImage(const QSize & size) const;
+    void _uploadTexture(const cv::Mat & image);
+};
+
+ReadbackTest::ReadbackTest():
+    m_gl(nullptr),
+    m_textureId(0)
+{
+}
+
+void ReadbackTest::initTestCase()
+{
+    QSurfaceFormat format;
+    format.setProfile(QSurfaceFormat::CompatibilityProfile);
+    format.setVersion(3, 3);
+    m_surface.setFormat(format);
+    m_surface.create();
+    m_context.setFormat(format);
+    if (!m_context.create() || !m_context.makeCurrent(&m_surface))
+        QSKIP("Coudn't create an OpenGL context");
+    if (m_context.format().majorVersion() < 3)
+        QSKIP("The packed gray shader needs OpenGL 3");
+    m_gl = m_context.functions();
+    m_gl->glGenTextures(1, &m_textureId);
+}
+
+void ReadbackTest::cleanupTestCase()
+{
+    if (m_textureId > 0)
+    {
+        m_gl->glDeleteTextures(1, &m_textureId);
+        m_context.doneCurrent();
+    }
+}
+
+void ReadbackTest::readback_data()
+{
+    QTest::addColumn<QSize>("size");
+    QTest::addColumn<bool>("packedGray");
+    QTest::addColumn<bool>("async");
+
+    // Widths not divisible by 4 leave a partially filled last packed pixel.
+    const QSize sizes[] = { QSize(640, 480), QSize(641, 481), QSize(637, 479),
+                            QSize(322, 241), QSize(7, 3), QSize(5, 1), QSize(1, 1) };
+    for (const QSize & size : sizes)
+    {
+        for (int mode = 0; mode < 4; ++mode)
+        {
+            bool packedGray = (mode & 1) != 0, async = (mode & 2) != 0;
+            QTest::newRow(QString("%1x%2 %3 %4").arg(size.width()).arg(size.height())
+                          .arg(packedGray ? "packed" : "color")
+                          .arg(async ? "async" : "sync").toLatin1().constData())
+                    << size << packedGray << async;
+        }
+    }
+}
+
+void ReadbackTest::readback()
+{
+    QFETCH(QSize, size);
+    QFETCH(bool, packedGray);
+    QFETCH(bool, async);
+
+    cv::Mat image = _createImage(size);
+    _uploadTexture(image);
+
+    // The quad maps the first row of the texture to the top of the framebuffer,
+    // glReadPixels returns the rows from the bottom.
+    cv::Mat expected;
+    cv::cvtColor(image, expected, cv::COLOR_RGBA2GRAY);
+    cv::flip(expected, expected, 0);
+
+    // The size is below the maximum, so the image is read without scaling.
+    QSize maxImageSize(size.width() + 1, size.height() + 1);
+    Texture2GrayImageConvertor convertor;
+    convertor.setPackedGrayReadback(packedGray);
+    convertor.setAsyncReadback(async);
+    int numberReads = async ? convertor.numberReadbackBuffers() : 1;
+    // The returned image belongs to the first read, so it gets the capture time of that read.
+    std::chrono::steady_clock::time_point firstCaptureTime = std::chrono::steady_clock::now();
+    cv::Mat result;
+    for (int i = 0; i < numberReads; ++i)
+    {
+        std::chrono::steady_clock::time_point captureTime = firstCaptureTime + std::chrono::milliseconds(i);
+        result = convertor.read(m_gl, m_textureId, size, maxImageSize, captureTime);
+        if (i < numberReads - 1)
+            QVERIFY(result.empty());
+        else
+            QVERIFY(captureTime == firstCaptureTime);
+    }
+
+    QCOMPARE(result.type(), CV_8UC1);
+    QCOMPARE(result.cols, size.width());
+    QCOMPARE(result.rows, size.height());
+    cv::Mat difference;
+    cv::compare(result, expected, difference, cv::CMP_NE);
+    QCOMPARE(cv::countNonZero(difference), 0);
+}
+
+cv::Mat ReadbackTest::_createImage(const QSize & size) const
+{
+    cv::Mat image(size.height(), size.width(), CV_8UC4);
+    cv::RNG rng(static_cast<uint64>(size.width() * 7919 + size.height()));
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+    // Pure black, white and primaries hit the ends of the fixed point weights.
+    const cv::Vec4b colors[] = { cv::Vec4b(0, 0, 0, 255), cv::Vec4b(255, 255, 255, 255),
+                                 cv::Vec4b(255, 0, 0, 255), cv::Vec4b(0, 255, 0, 255),
+                                 cv::Vec4b(0, 0, 255, 255) };
+    for (int i = 0; i < 5 && i < size.width(); ++i)
+        image.at<cv::Vec4b>(0, i) = colors[i];
+    return image;
+}
+
+void ReadbackTest::_uploadTexture(const cv::Mat & image)
+{
+    m_gl->glBindTexture(GL_TEXTURE_2D, m_textureId);
+    m_gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    m_gl->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.cols, image.rows,
+                       0, GL_RGBA, GL_UNSIGNED_BYTE, image.data);
+    // Sampling at the pixel centers of the same size is exact only without filtering.
+    m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    m_gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+QTEST_MAIN(ReadbackTest)
+
+#include "main.moc"
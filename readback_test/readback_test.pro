@@ -0,0 +1,20 @@
+QT = core gui quick testlib
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+TARGET = readback_test
+TEMPLATE = app
+
+include(../tracker.pri)
+include(../gl/gl.pri)
+
+HEADERS += \
+    ../texture2grayimageconvertor.h
+
+SOURCES += \
+    ../texture2grayimageconvertor.cpp \
+    main.cpp
+
+RESOURCES += \
+    ../shaders.qrc
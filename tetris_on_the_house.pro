@@ -6,36 +6,19 @@ CONFIG += c++11
 TARGET = Tetris
 TEMPLATE = app
 
-include(eigen3.pri)
-include(opencv.pri)
+include(tracker.pri)
 include(gl/gl.pri)
 include(game/game.pri)
 
 HEADERS += \
-    debugimageobject.h \
     framehandler.h \
-    objectedgestracker.h \
-    objectmodel.h \
-    pinholecamera.h \
-    performancemonitor.h \
-    poseoptimizer.h \
     texture2grayimageconvertor.h \
-    poseoptimizer2.h \
-    posefilter.h \
     texturereceiver.h
 
 SOURCES += \
-    debugimageobject.cpp \
     main.cpp \
     framehandler.cpp \
-    objectedgestracker.cpp \
-    objectmodel.cpp \
-    pinholecamera.cpp \
-    performancemonitor.cpp \
-    poseoptimizer.cpp \
     texture2grayimageconvertor.cpp \
-    poseoptimizer2.cpp \
-    posefilter.cpp \
     texturereceiver.cpp
 
 RESOURCES += \
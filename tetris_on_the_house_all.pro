@@ -0,0 +1,12 @@
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    app \
+    tracker_bench \
+    readback_test \
+    allocation_test
+
+app.file = tetris_on_the_house.pro
+tracker_bench.file = tracker_bench/tracker_bench.pro
+readback_test.file = readback_test/readback_test.pro
+allocation_test.file = allocation_test/allocation_test.pro
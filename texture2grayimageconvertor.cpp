@@ -1,15 +1,21 @@
 #include "texture2grayimageconvertor.h"
 
 #include <cmath>
+#include <algorithm>
 
 #include <QtMath>
 #include <QMap>
+#include <QOpenGLContext>
 
 #include <opencv2/imgproc.hpp>
 
 #include "gl/gl_view.h"
 
-Texture2GrayImageConvertor::Texture2GrayImageConvertor()
+Texture2GrayImageConvertor::Texture2GrayImageConvertor():
+    m_packedGrayReadback(true),
+    m_asyncReadback(true),
+    m_numberReadbackBuffers(2),
+    m_currentReadbackBuffer(0)
 {
     QSharedPointer<QOpenGLShaderProgram> programPtr = GL_ViewRenderer::loadShader(":/shaders/texture.vsh",
                                                                                   ":/shaders/texture.fsh");
@@ -20,30 +26,65 @@ Texture2GrayImageConvertor::Texture2GrayImageConvertor()
                                              ":/shaders/packed_gray_image.fsh");
     m_materialPackedGray = GL_ShaderMaterialPtr::create(programPtr,
                                                         QVariantMap({ { "matrixMVP", _getMatrixMVP(0, false) },
-                                                                      { "offsets[0]", 0 },
-                                                                      { "offsets[1]", 1 },
-                                                                      { "offsets[2]", 2 },
-                                                                      { "offsets[3]", 3 } }),
+                                                                      { "imageWidth", 0 } }),
                                                         QMap<QString, GLuint>({ { "main_texture", 0 } }));
     m_quad = GL_MeshPtr::create(GL_Mesh::createQuad());
 }
 
+Texture2GrayImageConvertor::~Texture2GrayImageConvertor()
+{
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+    if (context != nullptr)
+        _deleteReadbackBuffers(context->extraFunctions());
+}
+
+bool Texture2GrayImageConvertor::packedGrayReadback() const
+{
+    return m_packedGrayReadback;
+}
+
+void Texture2GrayImageConvertor::setPackedGrayReadback(bool packedGrayReadback)
+{
+    m_packedGrayReadback = packedGrayReadback;
+}
+
+bool Texture2GrayImageConvertor::asyncReadback() const
+{
+    return m_asyncReadback;
+}
+
+void Texture2GrayImageConvertor::setAsyncReadback(bool asyncReadback)
+{
+    m_asyncReadback = asyncReadback;
+}
+
+int Texture2GrayImageConvertor::numberReadbackBuffers() const
+{
+    return m_numberReadbackBuffers;
+}
+
+void Texture2GrayImageConvertor::setNumberReadbackBuffers(int numberReadbackBuffers)
+{
+    m_numberReadbackBuffers = std::max(numberReadbackBuffers, 2);
+}
+
 cv::Mat Texture2GrayImageConvertor::read(QOpenGLFunctions * gl,
                                          GLuint textureId,
                                          QSize textureSize,
                                          const QSize & maxImageSize,
+                                         std::chrono::steady_clock::time_point & captureTime,
                                          int orientation, bool flipHorizontally)
 {
     orientation = ((orientation / 90) % 4) * 90;
     if ((orientation == 90) || (orientation == 270))
         textureSize = QSize(textureSize.height(), textureSize.width());
-    QSize imageSize = _getImageSize(textureSize, maxImageSize, true);
+    QSize imageSize = _getImageSize(textureSize, maxImageSize);
     if (!m_fboColor ||
             (m_fboColor->width() < imageSize.width()) ||
             (m_fboColor->height() < imageSize.height()))
     {
         m_fboColor = QSharedPointer<QOpenGLFramebufferObject>::create(imageSize);
-        m_fboPackedGray = QSharedPointer<QOpenGLFramebufferObject>::create(imageSize.width() / 4,
+        m_fboPackedGray = QSharedPointer<QOpenGLFramebufferObject>::create(_packedWidth(imageSize.width()),
                                                                            imageSize.height());
     }
     m_materialColor->setTexture("main_texture", textureId);
@@ -54,23 +95,10 @@ cv::Mat Texture2GrayImageConvertor::read(QOpenGLFunctions * gl,
     gl->glDisable(GL_DEPTH_TEST);
     gl->glDepthMask(GL_FALSE);
     m_quad->draw(gl, *m_materialColor);
-    /*m_fboPackedGray->bind();
-    gl->glViewport(0, 0, imageSize.width() / 4, imageSize.height());
-    gl->glEnable(GL_BLEND);
-    gl->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    gl->glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-    gl->glClear(GL_COLOR_BUFFER_BIT);
-    m_materialPackedGray->setTexture("main_texture", m_fboColor->texture());
-    m_materialPackedGray->setValue("offsets[3]", 30);
-    m_materialPackedGray->setValue("offsets[2]", 2);
-    m_materialPackedGray->setValue("offsets[1]", 1);
-    m_materialPackedGray->setValue("offsets[0]", 0);
-    m_quad->draw(gl, *m_materialPackedGray);
-    cv::Mat image(imageSize.height(), imageSize.width(), CV_8UC1);
-    gl->glReadPixels(0, 0, imageSize.width() / 4, imageSize.height(), GL_RGBA, GL_UNSIGNED_BYTE, image.data);*/
-    cv::Mat image(imageSize.height(), imageSize.width(), CV_8UC4);
-    gl->glReadPixels(0, 0, imageSize.width(), imageSize.height(), GL_RGBA, GL_UNSIGNED_BYTE, image.data);
-    cv::cvtColor(image, image, cv::COLOR_RGBA2GRAY);
+    if (m_packedGrayReadback)
+        _packGray(gl, imageSize);
+    cv::Mat image;
+    std::tie(image, std::ignore) = _readImage(gl, imageSize, QVector2D(1.0f, 1.0f), captureTime);
     gl->glDisable(GL_BLEND);
     m_fboPackedGray->release();
     return image;
@@ -81,13 +109,14 @@ std::tuple<cv::Mat, QVector2D> Texture2GrayImageConvertor::read_cropped(QOpenGLF
                                                                         QSize textureSize,
                                                                         const QSize & maxImageSize,
                                                                         float viewAspect,
+                                                                        std::chrono::steady_clock::time_point & captureTime,
                                                                         int orientation,
                                                                         bool flipHorizontally)
 {
     orientation = ((orientation / 90) % 4) * 90;
     if ((orientation == 90) || (orientation == 270))
         textureSize = QSize(textureSize.height(), textureSize.width());
-    QSize imageSize = _getImageSize(textureSize, maxImageSize, false);
+    QSize imageSize = _getImageSize(textureSize, maxImageSize);
     QVector2D scale(1.0f, 1.0f);
     {
         float width = imageSize.height() * viewAspect, height = static_cast<float>(imageSize.height());
@@ -97,12 +126,6 @@ std::tuple<cv::Mat, QVector2D> Texture2GrayImageConvertor::read_cropped(QOpenGLF
             height = imageSize.width() / viewAspect;
         }
         QSize imageSize1(static_cast<int>(ceil(width)), static_cast<int>(ceil(height)));
-        if (imageSize1.width() % 4 != 0)
-        {
-            int w = (imageSize1.width() / 4) * 4;
-            float scale = w / static_cast<float>(imageSize1.width());
-            imageSize1 = QSize(w, static_cast<int>(imageSize1.height() * scale));
-        }
         scale = QVector2D(imageSize1.width() / static_cast<float>(imageSize.width()),
                           imageSize1.height() / static_cast<float>(imageSize.height()));
         imageSize = imageSize1;
@@ -114,7 +137,7 @@ std::tuple<cv::Mat, QVector2D> Texture2GrayImageConvertor::read_cropped(QOpenGLF
             (m_fboColor->height() < imageSize.height()))
     {
         m_fboColor = QSharedPointer<QOpenGLFramebufferObject>::create(imageSize);
-        m_fboPackedGray = QSharedPointer<QOpenGLFramebufferObject>::create(imageSize.width() / 4,
+        m_fboPackedGray = QSharedPointer<QOpenGLFramebufferObject>::create(_packedWidth(imageSize.width()),
                                                                            imageSize.height());
     }
     m_materialColor->setTexture("main_texture", textureId);
@@ -126,58 +149,163 @@ std::tuple<cv::Mat, QVector2D> Texture2GrayImageConvertor::read_cropped(QOpenGLF
     gl->glDisable(GL_CULL_FACE);
     gl->glDepthMask(GL_FALSE);
     m_quad->draw(gl, *m_materialColor);
-    /*m_fboPackedGray->bind();
-    gl->glViewport(0, 0, imageSize.width() / 4, imageSize.height());
-    gl->glEnable(GL_BLEND);
-    gl->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    gl->glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-    gl->glClear(GL_COLOR_BUFFER_BIT);
-    m_materialPackedGray->setTexture("main_texture", m_fboColor->texture());
-    m_materialPackedGray->setValue("offsets[0]", 0);
-    m_materialPackedGray->setValue("offsets[1]", 1);
-    m_materialPackedGray->setValue("offsets[2]", 2);
-    m_materialPackedGray->setValue("offsets[3]", 3);
-    m_quad->draw(gl, *m_materialPackedGray);
-    cv::Mat image(imageSize.height(), imageSize.width(), CV_8UC1);
-    gl->glReadPixels(0, 0, imageSize.width() / 4, imageSize.height(), GL_RGBA, GL_UNSIGNED_BYTE, image.data);*/
-    cv::Mat image(imageSize.height(), imageSize.width(), CV_8UC4);
-    gl->glReadPixels(0, 0, imageSize.width(), imageSize.height(), GL_RGBA, GL_UNSIGNED_BYTE, image.data);
-    cv::cvtColor(image, image, cv::COLOR_RGBA2GRAY);
+    if (m_packedGrayReadback)
+        _packGray(gl, imageSize);
+    cv::Mat image;
+    std::tie(image, scale) = _readImage(gl, imageSize, scale, captureTime);
     gl->glDisable(GL_BLEND);
     gl->glEnable(GL_CULL_FACE);
     m_fboPackedGray->release();
     return std::make_tuple(image, scale);
 }
 
-QSize Texture2GrayImageConvertor::_getImageSize(const QSize & textureSize,
-                                                QSize maxImageSize, bool k4fixFlag) const
+std::tuple<cv::Mat, QVector2D> Texture2GrayImageConvertor::_readImage(QOpenGLFunctions * gl,
+                                                                      const QSize & imageSize,
+                                                                      const QVector2D & scale,
+                                                                      std::chrono::steady_clock::time_point & captureTime)
 {
-    if ((textureSize.width() < maxImageSize.width()) && (textureSize.height() < maxImageSize.height()))
+    if (m_asyncReadback)
+    {
+        QOpenGLContext * context = QOpenGLContext::currentContext();
+        if ((context != nullptr) && (context->format().majorVersion() >= 3))
+        {
+            return _readImageAsync(context->extraFunctions(), imageSize, scale, captureTime);
+        }
+    }
+    if (m_packedGrayReadback)
+    {
+        int packedWidth = _packedWidth(imageSize.width());
+        cv::Mat image(imageSize.height(), packedWidth * 4, CV_8UC1);
+        gl->glReadPixels(0, 0, packedWidth, imageSize.height(), GL_RGBA, GL_UNSIGNED_BYTE, image.data);
+        return std::make_tuple(image.colRange(0, imageSize.width()), scale);
+    }
+    cv::Mat image(imageSize.height(), imageSize.width(), CV_8UC4);
+    gl->glReadPixels(0, 0, imageSize.width(), imageSize.height(), GL_RGBA, GL_UNSIGNED_BYTE, image.data);
+    cv::cvtColor(image, image, cv::COLOR_RGBA2GRAY);
+    return std::make_tuple(image, scale);
+}
+
+std::tuple<cv::Mat, QVector2D> Texture2GrayImageConvertor::_readImageAsync(QOpenGLExtraFunctions * gl,
+                                                                           const QSize & imageSize,
+                                                                           const QVector2D & scale,
+                                                                           std::chrono::steady_clock::time_point & captureTime)
+{
+    if (m_readbackBuffers.size() != m_numberReadbackBuffers)
+        _initReadbackBuffers(gl);
+
+    // The pixels of the current frame are only queued here. The returned image is
+    // the oldest frame of the ring, which the GPU has finished a few frames ago.
+    ReadbackBuffer & writeBuffer = m_readbackBuffers[m_currentReadbackBuffer];
+    int readWidth = m_packedGrayReadback ? _packedWidth(imageSize.width()) : imageSize.width();
+    int bufferSize = readWidth * imageSize.height() * 4;
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, writeBuffer.pbo);
+    if (writeBuffer.bufferSize != bufferSize)
+    {
+        gl->glBufferData(GL_PIXEL_PACK_BUFFER, bufferSize, nullptr, GL_STREAM_READ);
+        writeBuffer.bufferSize = bufferSize;
+    }
+    gl->glReadPixels(0, 0, readWidth, imageSize.height(), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    writeBuffer.fence = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    writeBuffer.packedGray = m_packedGrayReadback;
+    writeBuffer.imageSize = imageSize;
+    writeBuffer.scale = scale;
+    writeBuffer.captureTime = captureTime;
+
+    m_currentReadbackBuffer = (m_currentReadbackBuffer + 1) % m_readbackBuffers.size();
+
+    ReadbackBuffer & readBuffer = m_readbackBuffers[m_currentReadbackBuffer];
+    cv::Mat image;
+    if (readBuffer.fence != nullptr)
+    {
+        GLenum status = gl->glClientWaitSync(readBuffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        gl->glDeleteSync(readBuffer.fence);
+        readBuffer.fence = nullptr;
+        // On a timeout or a failed wait the frame is skipped, mapping the buffer
+        // would stall until the GPU is done or read unfinished pixels.
+        if ((status == GL_ALREADY_SIGNALED) || (status == GL_CONDITION_SATISFIED))
+            _mapReadbackBuffer(gl, readBuffer, image);
+    }
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    captureTime = readBuffer.captureTime;
+    return std::make_tuple(image, readBuffer.scale);
+}
+
+void Texture2GrayImageConvertor::_mapReadbackBuffer(QOpenGLExtraFunctions * gl,
+                                                    const ReadbackBuffer & readBuffer, cv::Mat & image)
+{
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, readBuffer.pbo);
+    void * data = gl->glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, readBuffer.bufferSize, GL_MAP_READ_BIT);
+    if (data != nullptr)
+    {
+        const QSize & size = readBuffer.imageSize;
+        if (readBuffer.packedGray)
+        {
+            cv::Mat(size.height(), size.width(), CV_8UC1, data,
+                    static_cast<size_t>(_packedWidth(size.width()) * 4)).copyTo(image);
+        }
+        else
+        {
+            cv::cvtColor(cv::Mat(size.height(), size.width(), CV_8UC4, data), image, cv::COLOR_RGBA2GRAY);
+        }
+        gl->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+}
+
+void Texture2GrayImageConvertor::_initReadbackBuffers(QOpenGLExtraFunctions * gl)
+{
+    _deleteReadbackBuffers(gl);
+    m_readbackBuffers.resize(m_numberReadbackBuffers);
+    for (ReadbackBuffer & buffer : m_readbackBuffers)
+    {
+        gl->glGenBuffers(1, &buffer.pbo);
+        buffer.fence = nullptr;
+        buffer.bufferSize = 0;
+        buffer.packedGray = false;
+        buffer.imageSize = QSize(0, 0);
+        buffer.scale = QVector2D(1.0f, 1.0f);
+        buffer.captureTime = std::chrono::steady_clock::time_point();
+    }
+    m_currentReadbackBuffer = 0;
+}
+
+void Texture2GrayImageConvertor::_deleteReadbackBuffers(QOpenGLExtraFunctions * gl)
+{
+    for (ReadbackBuffer & buffer : m_readbackBuffers)
     {
-        if (!k4fixFlag || (textureSize.width() % 4 == 0))
-            return textureSize;
-        if (k4fixFlag)
-            maxImageSize.setWidth((maxImageSize.width() / 4) * 4);
-        QSize imageSize;
-        imageSize.setWidth((textureSize.width() / 4) * 4);
-        float scale = imageSize.width() / static_cast<float>(textureSize.width());
-        imageSize.setHeight(static_cast<int>(textureSize.height() * scale));
-        return imageSize;
+        if (buffer.fence != nullptr)
+            gl->glDeleteSync(buffer.fence);
+        gl->glDeleteBuffers(1, &buffer.pbo);
     }
+    m_readbackBuffers.clear();
+}
+
+QSize Texture2GrayImageConvertor::_getImageSize(const QSize & textureSize,
+                                                const QSize & maxImageSize) const
+{
+    if ((textureSize.width() < maxImageSize.width()) && (textureSize.height() < maxImageSize.height()))
+        return textureSize;
     float aspect = textureSize.height() / static_cast<float>(textureSize.width());
     QSize imageSize(maxImageSize.width(), static_cast<int>(maxImageSize.width() * aspect));
     if (imageSize.height() > maxImageSize.height())
         imageSize = QSize(static_cast<int>(maxImageSize.height() / aspect), maxImageSize.height());
-    if (k4fixFlag)
-    {
-        int width = (imageSize.width() / 4) * 4;
-        float scale = width / static_cast<float>(imageSize.width());
-        imageSize.setWidth(width);
-        imageSize.setHeight(static_cast<int>(imageSize.height() * scale));
-    }
     return imageSize;
 }
 
+int Texture2GrayImageConvertor::_packedWidth(int width) const
+{
+    return (width + 3) / 4;
+}
+
+void Texture2GrayImageConvertor::_packGray(QOpenGLFunctions * gl, const QSize & imageSize)
+{
+    m_fboPackedGray->bind();
+    gl->glViewport(0, 0, _packedWidth(imageSize.width()), imageSize.height());
+    gl->glDisable(GL_BLEND);
+    m_materialPackedGray->setTexture("main_texture", m_fboColor->texture());
+    m_materialPackedGray->setValue("imageWidth", imageSize.width());
+    m_quad->draw(gl, *m_materialPackedGray);
+}
+
 QMatrix4x4 Texture2GrayImageConvertor::_getRotation(int orientation) const
 {
     QMatrix4x4 rotation;
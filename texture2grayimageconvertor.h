@@ -2,10 +2,14 @@
 #define TEXTURE2GRAYIMAGECONVERTOR_H
 
 #include <tuple>
+#include <chrono>
 
 #include <QSize>
 #include <QSharedPointer>
+#include <QVector>
+#include <QVector2D>
 #include <QOpenGLFunctions>
+#include <QOpenGLExtraFunctions>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLFramebufferObject>
 #include <QMatrix4x4>
@@ -19,11 +23,27 @@ class Texture2GrayImageConvertor
 {
 public:
     Texture2GrayImageConvertor();
+    ~Texture2GrayImageConvertor();
 
+    bool packedGrayReadback() const;
+    void setPackedGrayReadback(bool packedGrayReadback);
+
+    // With the async readback an image is returned numberReadbackBuffers - 1 frames later,
+    // so the first frames after the start or a change of the number of buffers are empty.
+    // A frame is also empty when the GPU has not finished its readback within a second.
+    bool asyncReadback() const;
+    void setAsyncReadback(bool asyncReadback);
+
+    int numberReadbackBuffers() const;
+    void setNumberReadbackBuffers(int numberReadbackBuffers);
+
+    // captureTime is the time of the frame in the texture. It is replaced with the time of the frame
+    // of the returned image, which is an older one with the async readback.
     cv::Mat read(QOpenGLFunctions * gl,
                  GLuint textureId,
                  QSize textureSize,
                  const QSize & maxImageSize,
+                 std::chrono::steady_clock::time_point & captureTime,
                  int orientation = 0,
                  bool flipHorizontally = false);
 
@@ -32,18 +52,47 @@ public:
                                                 QSize textureSize,
                                                 const QSize & maxImageSize,
                                                 float viewAspect,
+                                                std::chrono::steady_clock::time_point & captureTime,
                                                 int orientation = 0,
                                                 bool flipHorizontally = false);
 
 private:
+    struct ReadbackBuffer
+    {
+        GLuint pbo;
+        GLsync fence;
+        int bufferSize;
+        bool packedGray;
+        QSize imageSize;
+        QVector2D scale;
+        std::chrono::steady_clock::time_point captureTime;
+    };
+
     GL_MeshPtr m_quad;
     GL_ShaderMaterialPtr m_materialColor;
     GL_ShaderMaterialPtr m_materialPackedGray;
     QSharedPointer<QOpenGLFramebufferObject> m_fboColor;
     QSharedPointer<QOpenGLFramebufferObject> m_fboPackedGray;
 
-    QSize _getImageSize(const QSize & textureSize,
-                        QSize maxImageSize, bool k4fixFlag) const;
+    bool m_packedGrayReadback;
+    bool m_asyncReadback;
+    int m_numberReadbackBuffers;
+    QVector<ReadbackBuffer> m_readbackBuffers;
+    int m_currentReadbackBuffer;
+
+    std::tuple<cv::Mat, QVector2D> _readImage(QOpenGLFunctions * gl,
+                                              const QSize & imageSize, const QVector2D & scale,
+                                              std::chrono::steady_clock::time_point & captureTime);
+    std::tuple<cv::Mat, QVector2D> _readImageAsync(QOpenGLExtraFunctions * gl,
+                                                   const QSize & imageSize, const QVector2D & scale,
+                                                   std::chrono::steady_clock::time_point & captureTime);
+    void _mapReadbackBuffer(QOpenGLExtraFunctions * gl, const ReadbackBuffer & readBuffer, cv::Mat & image);
+    void _initReadbackBuffers(QOpenGLExtraFunctions * gl);
+    void _deleteReadbackBuffers(QOpenGLExtraFunctions * gl);
+
+    QSize _getImageSize(const QSize & textureSize, const QSize & maxImageSize) const;
+    int _packedWidth(int width) const;
+    void _packGray(QOpenGLFunctions * gl, const QSize & imageSize);
     QMatrix4x4 _getRotation(int orientation) const;
     QMatrix4x4 _getViewMatrix(float scaleX, float scaleY) const;
 
@@ -0,0 +1,39 @@
+#include "tiledimage.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+void tileImage(const cv::Mat & image, cv::Mat & tiledImage)
+{
+    CV_Assert((image.channels() == 1) && !image.empty());
+    CV_Assert(image.data != tiledImage.data);
+
+    int numberTileRows = (image.rows + imageTileSize - 1) >> imageTileShift;
+    int numberTileCols = (image.cols + imageTileSize - 1) >> imageTileShift;
+    tiledImage.create(numberTileRows, numberTileCols,
+                      CV_MAKETYPE(image.depth(), imageTileSize * imageTileSize));
+
+    size_t pixelSize = image.elemSize();
+    size_t tileRowSize = pixelSize * imageTileSize;
+    for (int y = 0; y < numberTileRows * imageTileSize; ++y)
+    {
+        const uchar * row = image.ptr<uchar>(min(y, image.rows - 1));
+        uchar * tileRow = tiledImage.ptr<uchar>(y >> imageTileShift) +
+                (y & (imageTileSize - 1)) * tileRowSize;
+        for (int tileX = 0; tileX < numberTileCols; ++tileX, tileRow += tiledImage.elemSize())
+        {
+            int x = tileX << imageTileShift;
+            int width = min(imageTileSize, image.cols - x);
+            memcpy(tileRow, row + x * pixelSize, width * pixelSize);
+            for (int i = width; i < imageTileSize; ++i)
+                memcpy(tileRow + i * pixelSize, row + (image.cols - 1) * pixelSize, pixelSize);
+        }
+    }
+}
+
+bool isTiledImage(const cv::Mat & image)
+{
+    return image.channels() == imageTileSize * imageTileSize;
+}
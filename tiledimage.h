@@ -0,0 +1,25 @@
+#ifndef TILEDIMAGE_H
+#define TILEDIMAGE_H
+
+#include <opencv2/core.hpp>
+
+// The side of a square tile of a tiled image.
+const int imageTileShift = 3;
+const int imageTileSize = 1 << imageTileShift;
+
+// A tiled image keeps the pixels of every 8x8 tile together, so the neighbouring rows of a pixel
+// are in the same few cache lines as the pixel itself. It is a cv::Mat of tiles, where every element
+// is a tile of imageTileSize * imageTileSize channels, the image is padded to whole tiles by its
+// last row and column.
+void tileImage(const cv::Mat & image, cv::Mat & tiledImage);
+
+bool isTiledImage(const cv::Mat & image);
+
+template <typename Type>
+inline const Type & tiledPixel(const cv::Mat & tiledImage, int x, int y)
+{
+    return tiledImage.ptr<Type>(y >> imageTileShift, x >> imageTileShift)
+            [((y & (imageTileSize - 1)) << imageTileShift) | (x & (imageTileSize - 1))];
+}
+
+#endif // TILEDIMAGE_H
@@ -0,0 +1,51 @@
+QT += concurrent
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+include($$PWD/eigen3.pri)
+include($$PWD/opencv.pri)
+
+HEADERS += \
+    $$PWD/debugimageobject.h \
+    $$PWD/objectedgestracker.h \
+    $$PWD/objectmodel.h \
+    $$PWD/pinholecamera.h \
+    $$PWD/performancemonitor.h \
+    $$PWD/poseoptimizer.h \
+    $$PWD/poseoptimizer2.h \
+    $$PWD/posefilter.h \
+    $$PWD/frametransform.h \
+    $$PWD/trackingworker.h \
+    $$PWD/framesource.h \
+    $$PWD/framerecording.h \
+    $$PWD/bloblabeler.h \
+    $$PWD/distancetransform.h \
+    $$PWD/preprocessor.h \
+    $$PWD/parallelstripes.h \
+    $$PWD/edgeorientations.h \
+    $$PWD/integralimage.h \
+    $$PWD/autothreshold.h \
+    $$PWD/tiledimage.h
+
+SOURCES += \
+    $$PWD/debugimageobject.cpp \
+    $$PWD/objectedgestracker.cpp \
+    $$PWD/objectmodel.cpp \
+    $$PWD/pinholecamera.cpp \
+    $$PWD/performancemonitor.cpp \
+    $$PWD/poseoptimizer.cpp \
+    $$PWD/poseoptimizer2.cpp \
+    $$PWD/posefilter.cpp \
+    $$PWD/frametransform.cpp \
+    $$PWD/trackingworker.cpp \
+    $$PWD/framesource.cpp \
+    $$PWD/framerecording.cpp \
+    $$PWD/bloblabeler.cpp \
+    $$PWD/distancetransform.cpp \
+    $$PWD/preprocessor.cpp \
+    $$PWD/parallelstripes.cpp \
+    $$PWD/edgeorientations.cpp \
+    $$PWD/integralimage.cpp \
+    $$PWD/autothreshold.cpp \
+    $$PWD/tiledimage.cpp
@@ -0,0 +1,495 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <QThreadPool>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QVariantMap>
+
+#include "performancemonitor.h"
+#include "objectedgestracker.h"
+#include "pinholecamera.h"
+#include "framesource.h"
+#include "framerecording.h"
+#include "frametransform.h"
+
+#include <opencv2/imgproc.hpp>
+
+#ifdef Q_OS_LINUX
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+struct RunConfig
+{
+    int numberThreads;
+    QVariantMap settings;
+};
+
+struct RunResult
+{
+    QString name;
+    int countFrames;
+    double fps;
+    double frameP50;
+    double frameP99;
+    double cacheMissRate;
+};
+
+// Counts the L1 data cache reads and read misses of the threads of the process, which exist at the start.
+// The thread pools are filled by the warmup frames, so the counters cover the whole tracker.
+class CacheCounters
+{
+public:
+    ~CacheCounters()
+    {
+        _close();
+    }
+
+    bool start()
+    {
+        _close();
+#ifdef Q_OS_LINUX
+        DIR * tasks = opendir("/proc/self/task");
+        if (tasks == nullptr)
+            return false;
+        while (dirent * entry = readdir(tasks))
+        {
+            if (entry->d_name[0] == '.')
+                continue;
+            pid_t threadId = static_cast<pid_t>(atoi(entry->d_name));
+            int readFd = _open(threadId, PERF_COUNT_HW_CACHE_RESULT_ACCESS);
+            int missFd = _open(threadId, PERF_COUNT_HW_CACHE_RESULT_MISS);
+            if ((readFd >= 0) && (missFd >= 0))
+            {
+                m_fds.push_back(readFd);
+                m_fds.push_back(missFd);
+            }
+            else
+            {
+                if (readFd >= 0)
+                    close(readFd);
+                if (missFd >= 0)
+                    close(missFd);
+            }
+        }
+        closedir(tasks);
+        for (int fd : m_fds)
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        return !m_fds.empty();
+#else
+        return false;
+#endif
+    }
+
+    // Returns the part of the reads which missed the cache.
+    double stop()
+    {
+        uint64_t reads = 0, misses = 0;
+#ifdef Q_OS_LINUX
+        for (size_t i = 0; i < m_fds.size(); i += 2)
+        {
+            uint64_t value = 0;
+            ioctl(m_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            ioctl(m_fds[i + 1], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(m_fds[i], &value, sizeof(value)) == sizeof(value))
+                reads += value;
+            if (read(m_fds[i + 1], &value, sizeof(value)) == sizeof(value))
+                misses += value;
+        }
+#endif
+        _close();
+        return (reads > 0) ? (misses / static_cast<double>(reads)) : 0.0;
+    }
+
+private:
+    vector<int> m_fds;
+
+#ifdef Q_OS_LINUX
+    static int _open(pid_t threadId, int result)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (static_cast<uint64_t>(result) << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return static_cast<int>(syscall(__NR_perf_event_open, &attr, threadId, -1, -1, 0));
+    }
+#endif
+
+    void _close()
+    {
+#ifdef Q_OS_LINUX
+        for (int fd : m_fds)
+            close(fd);
+#endif
+        m_fds.clear();
+    }
+};
+
+class StageDurations
+{
+public:
+    void add(const string & name, double duration)
+    {
+        auto it = m_durations.find(name);
+        if (it == m_durations.end())
+        {
+            m_names.push_back(name);
+            it = m_durations.insert({ name, vector<double>() }).first;
+        }
+        it->second.push_back(duration);
+    }
+
+    const vector<string> & names() const
+    {
+        return m_names;
+    }
+
+    vector<double> & durations(const string & name)
+    {
+        return m_durations[name];
+    }
+
+private:
+    vector<string> m_names;
+    map<string, vector<double>> m_durations;
+};
+
+// Nearest-rank percentile of sorted values.
+double percentile(const vector<double> & sortedValues, double p)
+{
+    if (sortedValues.empty())
+        return 0.0;
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sortedValues.size()));
+    return sortedValues[std::min(std::max(rank, static_cast<size_t>(1)), sortedValues.size()) - 1];
+}
+
+void quietMessageHandler(QtMsgType type, const QMessageLogContext & context, const QString & message)
+{
+    Q_UNUSED(context);
+    if (type == QtDebugMsg)
+        return;
+    fprintf(stderr, "%s\n", qPrintable(message));
+}
+
+bool isRecording(const QString & path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    QByteArray magic = file.read(sizeof(recording::fileMagic));
+    return (magic.size() == sizeof(recording::fileMagic)) &&
+            (memcmp(magic.constData(), recording::fileMagic, sizeof(recording::fileMagic)) == 0);
+}
+
+QSharedPointer<FrameSource> openFrameSource(const QString & path,
+                                            const QSize & maxFrameSize,
+                                            const QVector2D & focalLength,
+                                            const QVector2D & opticalCenter,
+                                            double frameRate,
+                                            QVariantMap & recordedSettings)
+{
+    if (QFileInfo(path).isDir())
+    {
+        return QSharedPointer<ImageDirectoryFrameSource>::create(path, maxFrameSize,
+                                                                 focalLength, opticalCenter, frameRate);
+    }
+    if (isRecording(path))
+    {
+        shared_ptr<FrameRecording> recording = FrameRecording::open(path);
+        if (!recording)
+            return QSharedPointer<FrameSource>();
+        recordedSettings = recording->settings();
+        return QSharedPointer<RecordingFrameSource>::create(recording);
+    }
+    QSharedPointer<VideoFileFrameSource> source = QSharedPointer<VideoFileFrameSource>::create(
+                path, maxFrameSize, focalLength, opticalCenter);
+    if (!source->isOpened())
+        return QSharedPointer<FrameSource>();
+    return source;
+}
+
+vector<RunConfig> createRunConfigs(const QStringList & threads, const QStringList & sets)
+{
+    vector<RunConfig> configs;
+    for (const QString & numberThreads : threads)
+        configs.push_back({ numberThreads.toInt(), QVariantMap() });
+    // Every listed value of a setting multiplies the runs.
+    for (const QString & set : sets)
+    {
+        int separator = set.indexOf('=');
+        if (separator <= 0)
+            qFatal("Wrong setting \"%s\", expected name=value[,value...]", qPrintable(set));
+        QString name = set.left(separator);
+        QStringList values = set.mid(separator + 1).split(',');
+        vector<RunConfig> nextConfigs;
+        for (const RunConfig & config : configs)
+        {
+            for (const QString & value : values)
+            {
+                RunConfig nextConfig = config;
+                nextConfig.settings.insert(name, value);
+                nextConfigs.push_back(nextConfig);
+            }
+        }
+        configs = nextConfigs;
+    }
+    return configs;
+}
+
+QString runName(const RunConfig & config)
+{
+    QString name = QString("threads=%1").arg(config.numberThreads);
+    for (auto it = config.settings.cbegin(); it != config.settings.cend(); ++it)
+        name += QString(" %1=%2").arg(it.key(), it.value().toString());
+    return name;
+}
+
+RunResult run(const RunConfig & config,
+              const vector<TrackingFrame> & frames,
+              const QVariantMap & recordedSettings,
+              int countWarmupFrames,
+              bool countCacheMisses)
+{
+    QThreadPool::globalInstance()->setMaxThreadCount(config.numberThreads);
+
+    QSharedPointer<PerformanceMonitor> monitor = QSharedPointer<PerformanceMonitor>::create();
+    ObjectEdgesTracker tracker(monitor);
+    FrameRecording::applySettings(&tracker, recordedSettings);
+    FrameRecording::applySettings(&tracker, config.settings);
+    tracker.setNumberWorkThreads(config.numberThreads);
+
+    StageDurations stageDurations;
+    const string frameStageName = "Frame";
+    int countMeasuredFrames = 0;
+    CacheCounters cacheCounters;
+    bool cacheCountersStarted = false;
+    steady_clock::time_point startTime = steady_clock::now();
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        if (static_cast<int>(i) == countWarmupFrames)
+        {
+            if (countCacheMisses)
+            {
+                cacheCountersStarted = cacheCounters.start();
+                if (!cacheCountersStarted)
+                    fprintf(stderr, "The cache counters are not available\n");
+            }
+            startTime = steady_clock::now();
+        }
+        const TrackingFrame & frame = frames[i];
+        monitor->start();
+        if (tracker.camera() != frame.camera)
+            tracker.setCamera(frame.camera);
+        tracker.compute(frame.image, frame.captureTime);
+        monitor->end();
+        if (static_cast<int>(i) < countWarmupFrames)
+            continue;
+        ++countMeasuredFrames;
+        stageDurations.add(frameStageName, monitor->lastCommonTime().count() / 1000.0);
+        for (const pair<string, microseconds> & d : monitor->lastDurations())
+        {
+            string name = d.first.substr(d.first.find_first_not_of(' '));
+            stageDurations.add(name, d.second.count() / 1000.0);
+        }
+    }
+    tracker.flush();
+    double elapsed = duration_cast<duration<double>>(steady_clock::now() - startTime).count();
+    double cacheMissRate = cacheCountersStarted ? cacheCounters.stop() : -1.0;
+
+    RunResult result;
+    result.name = runName(config);
+    result.countFrames = countMeasuredFrames;
+    result.fps = (elapsed > 0.0) ? (countMeasuredFrames / elapsed) : 0.0;
+    result.cacheMissRate = cacheMissRate;
+
+    printf("\n%s\n", qPrintable(result.name));
+    printf("    frames: %d, fps: %.1f\n", result.countFrames, result.fps);
+    if (result.cacheMissRate >= 0.0)
+        printf("    L1d read misses: %.2f%%\n", result.cacheMissRate * 100.0);
+    printf("    %-32s %10s %10s %10s\n", "stage [ms]", "p50", "p95", "p99");
+    for (const string & name : stageDurations.names())
+    {
+        vector<double> & durations = stageDurations.durations(name);
+        sort(durations.begin(), durations.end());
+        printf("    %-32s %10.3f %10.3f %10.3f\n", name.c_str(),
+               percentile(durations, 50.0), percentile(durations, 95.0), percentile(durations, 99.0));
+    }
+    vector<double> & frameDurations = stageDurations.durations(frameStageName);
+    result.frameP50 = percentile(frameDurations, 50.0);
+    result.frameP99 = percentile(frameDurations, 99.0);
+    return result;
+}
+
+// Compares the fused ingest kernel with the separate OpenCV passes it replaces.
+void benchIngest(const QSize & maxFrameSize)
+{
+    const int countIterations = 100;
+    cv::Size maxSize(maxFrameSize.width(), maxFrameSize.height());
+    // 1920x1080 is reduced by an integer factor only, 1600x1200 needs the fractional last pass.
+    const cv::Size frameSizes[] = { cv::Size(1920, 1080), cv::Size(1600, 1200) };
+    for (const cv::Size & frameSize : frameSizes)
+    {
+        cv::Mat frame(frameSize, CV_8UC4);
+        cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+
+        printf("\ningest of a %dx%d BGRA frame [ms]\n", frame.cols, frame.rows);
+        printf("    %-12s %12s %12s\n", "orientation", "fused", "opencv");
+        for (int orientation = 0; orientation < 360; orientation += 90)
+        {
+            ImageOrientation imageOrientation = ImageOrientation::create(orientation, false);
+            cv::Mat fused, fusedBuffer, gray, scaled, oriented;
+
+            steady_clock::time_point startTime = steady_clock::now();
+            for (int i = 0; i < countIterations; ++i)
+                orientedGrayDownscale(frame, fused, PixelLayout::BGRA, maxSize, imageOrientation, &fusedBuffer);
+            double fusedTime = duration_cast<duration<double, milli>>(steady_clock::now() - startTime).count();
+
+            // The path that the fused pass replaced.
+            startTime = steady_clock::now();
+            for (int i = 0; i < countIterations; ++i)
+            {
+                cv::cvtColor(frame, gray, cv::COLOR_BGRA2GRAY);
+                cv::Size scaledSize = imageOrientation.transpose ? cv::Size(fused.rows, fused.cols) : fused.size();
+                cv::resize(gray, scaled, scaledSize);
+                if (imageOrientation.transpose)
+                    cv::transpose(scaled, oriented);
+                else
+                    oriented = scaled;
+                if (imageOrientation.flipRows || imageOrientation.flipColumns)
+                {
+                    cv::flip(oriented, oriented, (imageOrientation.flipRows && imageOrientation.flipColumns) ? -1 :
+                                                 (imageOrientation.flipRows ? 0 : 1));
+                }
+            }
+            double openCVTime = duration_cast<duration<double, milli>>(steady_clock::now() - startTime).count();
+
+            printf("    %-12d %12.3f %12.3f\n", orientation,
+                   fusedTime / countIterations, openCVTime / countIterations);
+        }
+    }
+}
+
+} // anonymous namespace
+
+int main(int argc, char * argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("tracker_bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs ObjectEdgesTracker over a recording, a video file or "
+                                     "an image directory and reports the latencies of its stages.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("input", "A recording, a video file or a directory of images.");
+    QCommandLineOption threadsOption("threads", "Comma separated numbers of work threads to compare.",
+                                     "counts", QString::number(QThread::idealThreadCount()));
+    QCommandLineOption setOption("set", "Sets a tracker property, several comma separated values are compared. "
+                                        "Can be repeated.", "name=value[,value...]");
+    QCommandLineOption warmupOption("warmup", "The number of frames that are not measured.", "count", "5");
+    QCommandLineOption maxFramesOption("max-frames", "The maximum number of read frames.", "count", "0");
+    QCommandLineOption maxSizeOption("max-size", "The maximum size of a frame for video and image input.",
+                                     "WxH", "640x480");
+    QCommandLineOption focalLengthOption("focal-length", "The relative focal length for video and image input.",
+                                         "fx,fy", "1,1");
+    QCommandLineOption opticalCenterOption("optical-center", "The relative optical center for video and image input.",
+                                           "cx,cy", "0.5,0.5");
+    QCommandLineOption frameRateOption("frame-rate", "The frame rate of image input.", "fps", "30");
+    QCommandLineOption verboseOption("verbose", "Prints the debug output of the tracker.");
+    QCommandLineOption ingestOption("ingest", "Measures the ingest of camera frames instead of the tracker.");
+    QCommandLineOption cacheMissesOption("cache-misses", "Counts the L1 data cache read misses of the runs "
+                                                         "with the perf events of Linux.");
+    parser.addOptions({ threadsOption, setOption, warmupOption, maxFramesOption, maxSizeOption,
+                        focalLengthOption, opticalCenterOption, frameRateOption, verboseOption,
+                        ingestOption, cacheMissesOption });
+    parser.process(app);
+
+    QStringList maxSize = parser.value(maxSizeOption).split('x');
+    QStringList focalLength = parser.value(focalLengthOption).split(',');
+    QStringList opticalCenter = parser.value(opticalCenterOption).split(',');
+    if ((maxSize.size() != 2) || (focalLength.size() != 2) || (opticalCenter.size() != 2))
+        parser.showHelp(1);
+
+    if (parser.isSet(ingestOption))
+    {
+        benchIngest(QSize(maxSize[0].toInt(), maxSize[1].toInt()));
+        return 0;
+    }
+
+    if (parser.positionalArguments().size() != 1)
+        parser.showHelp(1);
+    if (!parser.isSet(verboseOption))
+        qInstallMessageHandler(quietMessageHandler);
+
+    QString inputPath = parser.positionalArguments().first();
+    QVariantMap recordedSettings;
+    QSharedPointer<FrameSource> frameSource = openFrameSource(
+                inputPath,
+                QSize(maxSize[0].toInt(), maxSize[1].toInt()),
+                QVector2D(focalLength[0].toFloat(), focalLength[1].toFloat()),
+                QVector2D(opticalCenter[0].toFloat(), opticalCenter[1].toFloat()),
+                parser.value(frameRateOption).toDouble(),
+                recordedSettings);
+    if (!frameSource)
+        qFatal("Couldn't open \"%s\"", qPrintable(inputPath));
+
+    // The frames are read once, so the runs measure only the tracker.
+    int maxFrames = parser.value(maxFramesOption).toInt();
+    vector<TrackingFrame> frames;
+    TrackingFrame frame;
+    while (((maxFrames <= 0) || (static_cast<int>(frames.size()) < maxFrames)) && frameSource->read(frame))
+        frames.push_back(frame);
+    if (frames.empty())
+        qFatal("No frames in \"%s\"", qPrintable(inputPath));
+    printf("%s: %d frames %dx%d\n", qPrintable(inputPath), static_cast<int>(frames.size()),
+           frames.front().image.cols, frames.front().image.rows);
+
+    vector<RunConfig> configs = createRunConfigs(parser.value(threadsOption).split(','),
+                                                 parser.values(setOption));
+    vector<RunResult> results;
+    for (const RunConfig & config : configs)
+    {
+        results.push_back(run(config, frames, recordedSettings, parser.value(warmupOption).toInt(),
+                              parser.isSet(cacheMissesOption)));
+    }
+
+    if (results.size() > 1)
+    {
+        printf("\n%-48s %10s %12s %12s %12s\n", "run", "fps", "p50 [ms]", "p99 [ms]", "L1d miss [%]");
+        for (const RunResult & result : results)
+        {
+            printf("%-48s %10.1f %12.3f %12.3f %12s\n", qPrintable(result.name),
+                   result.fps, result.frameP50, result.frameP99,
+                   (result.cacheMissRate >= 0.0) ?
+                       qPrintable(QString::number(result.cacheMissRate * 100.0, 'f', 2)) : "-");
+        }
+    }
+    return 0;
+}
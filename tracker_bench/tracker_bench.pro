@@ -0,0 +1,12 @@
+QT = core gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = tracker_bench
+TEMPLATE = app
+
+include(../tracker.pri)
+
+SOURCES += \
+    main.cpp
@@ -0,0 +1,102 @@
+#include "trackingworker.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+
+#include "performancemonitor.h"
+#include "pinholecamera.h"
+#include "objectedgestracker.h"
+#include "framesource.h"
+#include "framerecording.h"
+
+using namespace std;
+
+TrackingWorker::TrackingWorker(ObjectEdgesTracker * tracker,
+                               const QSharedPointer<PerformanceMonitor> & monitor,
+                               const QSharedPointer<FrameSource> & frameSource):
+    m_tracker(tracker),
+    m_monitor(monitor),
+    m_frameSource(frameSource),
+    m_stopped(false),
+    m_countProcessedFrames(0)
+{
+}
+
+TrackingWorker::~TrackingWorker()
+{
+    stop();
+    wait();
+}
+
+int TrackingWorker::countProcessedFrames() const
+{
+    return m_countProcessedFrames;
+}
+
+void TrackingWorker::setRecorder(const shared_ptr<FrameRecorder> & recorder)
+{
+    QMutexLocker locker(&m_recorderMutex);
+    m_recorder = recorder;
+}
+
+void TrackingWorker::stop()
+{
+    m_stopped = true;
+    m_frameSource->stop();
+}
+
+void TrackingWorker::run()
+{
+    // With the pipelining the pose of a frame is known only after the next frame,
+    // so the recorded frames wait here for their poses.
+    deque<RecordedFrame> recordedFrames;
+    TrackingFrame frame;
+    int frameIndex = 0;
+    while (!m_stopped && m_frameSource->read(frame))
+    {
+        shared_ptr<FrameRecorder> recorder;
+        {
+            QMutexLocker locker(&m_recorderMutex);
+            recorder = m_recorder;
+        }
+
+        m_monitor->start();
+        if (recorder)
+        {
+            m_monitor->startTimer("Recording");
+            RecordedFrame recordedFrame;
+            recordedFrame.frameIndex = frameIndex;
+            recordedFrame.recorder = recorder;
+            recordedFrame.recordIndex = recorder->writeFrame(frame);
+            if (recordedFrame.recordIndex >= 0)
+                recordedFrames.push_back(recordedFrame);
+            m_monitor->endTimer("Recording");
+        }
+        if (m_tracker->camera() != frame.camera)
+            m_tracker->setCamera(frame.camera);
+        m_tracker->compute(frame.image, frame.captureTime, frameIndex);
+        _writeTrackedPose(recordedFrames);
+        m_monitor->end();
+        ++frameIndex;
+        ++m_countProcessedFrames;
+        qDebug().noquote() << QString::fromStdString(m_monitor->report());
+
+        // Releases the image before waiting, so the producer can reuse its buffer.
+        frame = TrackingFrame();
+    }
+    m_tracker->flush();
+    _writeTrackedPose(recordedFrames);
+}
+
+void TrackingWorker::_writeTrackedPose(deque<RecordedFrame> & recordedFrames) const
+{
+    int frameIndex = m_tracker->trackedFrameIndex();
+    while (!recordedFrames.empty() && (recordedFrames.front().frameIndex <= frameIndex))
+    {
+        const RecordedFrame & recordedFrame = recordedFrames.front();
+        if (recordedFrame.frameIndex == frameIndex)
+            recordedFrame.recorder->writePose(recordedFrame.recordIndex,
+                                              m_tracker->currentPose(), m_tracker->trackingQuality());
+        recordedFrames.pop_front();
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef TRACKINGWORKER_H
+#define TRACKINGWORKER_H
+
+#include <atomic>
+#include <memory>
+#include <deque>
+
+#include <QThread>
+#include <QMutex>
+#include <QSharedPointer>
+
+class PerformanceMonitor;
+class ObjectEdgesTracker;
+class FrameSource;
+class FrameRecorder;
+
+// Runs the tracker on its own thread with the frames of a frame source.
+class TrackingWorker:
+        public QThread
+{
+    Q_OBJECT
+public:
+    TrackingWorker(ObjectEdgesTracker * tracker,
+                   const QSharedPointer<PerformanceMonitor> & monitor,
+                   const QSharedPointer<FrameSource> & frameSource);
+    ~TrackingWorker() override;
+
+    int countProcessedFrames() const;
+
+    // The frames and the tracking results are written to the recorder, if it is set.
+    void setRecorder(const std::shared_ptr<FrameRecorder> & recorder);
+
+    void stop();
+
+protected:
+    void run() override;
+
+private:
+    // A recorded frame which waits for its pose.
+    struct RecordedFrame
+    {
+        int frameIndex;
+        std::shared_ptr<FrameRecorder> recorder;
+        int recordIndex;
+    };
+
+    ObjectEdgesTracker * m_tracker;
+    QSharedPointer<PerformanceMonitor> m_monitor;
+    QSharedPointer<FrameSource> m_frameSource;
+
+    QMutex m_recorderMutex;
+    std::shared_ptr<FrameRecorder> m_recorder;
+
+    std::atomic<bool> m_stopped;
+    std::atomic<int> m_countProcessedFrames;
+
+    // Writes the pose of the frame which is tracked last, the frames before it are left without poses.
+    void _writeTrackedPose(std::deque<RecordedFrame> & recordedFrames) const;
+};
+
+#endif // TRACKINGWORKER_H